@@ -0,0 +1,247 @@
+#include <defs.h>
+#include <list.h>
+#include <string.h>
+#include <sem.h>
+#include <fs.h>
+#include <ide.h>
+#include <blkqueue.h>
+#include <stdio.h>
+#include <assert.h>
+
+static void
+lock_queue(struct blk_queue *q) {
+    down(&(q->sem));
+}
+
+static void
+unlock_queue(struct blk_queue *q) {
+    up(&(q->sem));
+}
+
+void
+blk_queue_init(struct blk_queue *q, unsigned short ideno) {
+    q->ideno = ideno;
+    q->plugged = 0;
+    list_init(&(q->queue));
+    list_init(&(q->free_list));
+    int i;
+    for (i = 0; i < BLK_NREQ; i ++) {
+        list_add(&(q->free_list), &(q->reqs[i].link));
+    }
+    sem_init(&(q->sem), 1);
+    q->stat.submitted = q->stat.merged = q->stat.dispatched = 0;
+}
+
+/*
+ * blk_dispatch - send one request to the device, in pieces of at most MAX_NSECS sectors.
+ */
+static int
+blk_dispatch(struct blk_queue *q, uint32_t secno, void *buf, size_t nsecs, bool write) {
+    int ret;
+    while (nsecs != 0) {
+        size_t n = (nsecs < MAX_NSECS) ? nsecs : MAX_NSECS;
+        if (write) {
+            ret = ide_write_secs(q->ideno, secno, buf, n);
+        }
+        else {
+            ret = ide_read_secs(q->ideno, secno, buf, n);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        q->stat.dispatched ++;
+        secno += n, buf += n * SECTSIZE, nsecs -= n;
+    }
+    return 0;
+}
+
+/*
+ * blk_flush_nolock - dispatch all queued writes, in ascending sector order.
+ *                    return the first error met, all requests are dropped anyway.
+ */
+static int
+blk_flush_nolock(struct blk_queue *q) {
+    int ret = 0;
+    list_entry_t *le;
+    while ((le = list_next(&(q->queue))) != &(q->queue)) {
+        struct blk_request *req = le2req(le, link);
+        uint32_t secno = req->secno;
+        int i, err;
+        for (i = 0; i < req->nseg; secno += req->segs[i ++].nsecs) {
+            if ((err = blk_dispatch(q, secno, req->segs[i].buf, req->segs[i].nsecs, 1)) != 0 && ret == 0) {
+                ret = err;
+            }
+        }
+        list_del(le);
+        list_add(&(q->free_list), le);
+    }
+    return ret;
+}
+
+/*
+ * blk_req_append - add @nsecs sectors in @buf after the end of @req, as a new segment unless
+ *                  @buf continues the last one in memory. return 0 if @req has no segment left.
+ */
+static bool
+blk_req_append(struct blk_request *req, void *buf, size_t nsecs) {
+    struct blk_seg *seg = req->segs + req->nseg - 1;
+    if (seg->buf + seg->nsecs * SECTSIZE != buf) {
+        if (req->nseg == BLK_NSEG) {
+            return 0;
+        }
+        seg = req->segs + req->nseg ++;
+        seg->buf = buf, seg->nsecs = 0;
+    }
+    seg->nsecs += nsecs, req->nsecs += nsecs;
+    return 1;
+}
+
+/*
+ * blk_req_prepend - add @nsecs sectors in @buf before the start of @req, as a new segment unless
+ *                   the first one continues @buf in memory. return 0 if @req has no segment left.
+ */
+static bool
+blk_req_prepend(struct blk_request *req, void *buf, size_t nsecs) {
+    struct blk_seg *seg = req->segs;
+    if (buf + nsecs * SECTSIZE != seg->buf) {
+        if (req->nseg == BLK_NSEG) {
+            return 0;
+        }
+        memmove(req->segs + 1, req->segs, req->nseg ++ * sizeof(struct blk_seg));
+        seg->nsecs = 0;
+    }
+    seg->buf = buf, seg->nsecs += nsecs;
+    req->secno -= nsecs, req->nsecs += nsecs;
+    return 1;
+}
+
+/*
+ * blk_req_join_next - merge the request following @req in the queue into it, if it now
+ *                     continues @req on disk and the segments of both fit in one request.
+ */
+static void
+blk_req_join_next(struct blk_queue *q, struct blk_request *req) {
+    list_entry_t *le = list_next(&(req->link));
+    if (le == &(q->queue)) {
+        return;
+    }
+    struct blk_request *next = le2req(le, link);
+    if (req->secno + req->nsecs == next->secno && req->nseg + next->nseg <= BLK_NSEG) {
+        int i;
+        for (i = 0; i < next->nseg; i ++) {
+            assert(blk_req_append(req, next->segs[i].buf, next->segs[i].nsecs));
+        }
+        list_del(le);
+        list_add(&(q->free_list), le);
+        q->stat.merged ++;
+    }
+}
+
+/*
+ * blk_queue_write_nolock - add a write to the sorted queue, merging it with a queued request
+ *                          it continues (or is continued by) on disk.
+ */
+static int
+blk_queue_write_nolock(struct blk_queue *q, uint32_t secno, void *buf, size_t nsecs) {
+    int ret;
+    uint32_t end = secno + nsecs;
+    list_entry_t *le = &(q->queue);
+    while ((le = list_next(le)) != &(q->queue)) {
+        struct blk_request *req = le2req(le, link);
+        if (secno < req->secno + req->nsecs && req->secno < end) {
+            // overwrites queued data, which must reach the disk first
+            goto flush;
+        }
+    }
+    while ((le = list_next(le)) != &(q->queue)) {
+        struct blk_request *req = le2req(le, link);
+        if (req->secno + req->nsecs == secno && blk_req_append(req, buf, nsecs)) {
+            // the write may fill the gap up to the next request
+            blk_req_join_next(q, req);
+            goto merged;
+        }
+        if (end == req->secno && blk_req_prepend(req, buf, nsecs)) {
+            goto merged;
+        }
+        if (secno < req->secno) {
+            break;
+        }
+    }
+    if (list_empty(&(q->free_list))) {
+        goto flush;
+    }
+    struct blk_request *req = le2req(list_next(&(q->free_list)), link);
+    list_del(&(req->link));
+    req->secno = secno, req->nsecs = nsecs, req->nseg = 1;
+    req->segs[0].buf = buf, req->segs[0].nsecs = nsecs;
+    list_add_before(le, &(req->link));
+    return 0;
+
+merged:
+    q->stat.merged ++;
+    return 0;
+
+flush:
+    if ((ret = blk_flush_nolock(q)) != 0) {
+        return ret;
+    }
+    return blk_dispatch(q, secno, buf, nsecs, 1);
+}
+
+/*
+ * blk_rw - Rd/Wr @nsecs sectors from @secno, between the device and @buf.
+ *          a write issued while the queue is plugged may only be queued, and then
+ *          @buf must stay untouched until blk_unplug.
+ */
+int
+blk_rw(struct blk_queue *q, uint32_t secno, void *buf, size_t nsecs, bool write) {
+    int ret;
+    lock_queue(q);
+    {
+        q->stat.submitted ++;
+        if (write && q->plugged != 0) {
+            ret = blk_queue_write_nolock(q, secno, buf, nsecs);
+        }
+        else if ((ret = blk_flush_nolock(q)) == 0) {
+            ret = blk_dispatch(q, secno, buf, nsecs, write);
+        }
+    }
+    unlock_queue(q);
+    return ret;
+}
+
+/*
+ * blk_plug - start a batch of writes, they are held back until the matching blk_unplug.
+ */
+void
+blk_plug(struct blk_queue *q) {
+    lock_queue(q);
+    q->plugged ++;
+    unlock_queue(q);
+}
+
+/*
+ * blk_unplug - end a batch, the outermost unplug dispatches all queued writes.
+ */
+int
+blk_unplug(struct blk_queue *q) {
+    int ret = 0;
+    lock_queue(q);
+    {
+        assert(q->plugged > 0);
+        if (-- q->plugged == 0) {
+            ret = blk_flush_nolock(q);
+        }
+    }
+    unlock_queue(q);
+    return ret;
+}
+
+/*
+ * blk_print_stat - report the counters of the queue serving device @name.
+ */
+void
+blk_print_stat(struct blk_queue *q, const char *name) {
+    cprintf("%s: submitted %d, merged %d, dispatched %d.\n",
+            name, q->stat.submitted, q->stat.merged, q->stat.dispatched);
+}
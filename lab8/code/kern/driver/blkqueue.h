@@ -0,0 +1,67 @@
+#ifndef __KERN_DRIVER_BLKQUEUE_H__
+#define __KERN_DRIVER_BLKQUEUE_H__
+
+#include <defs.h>
+#include <list.h>
+#include <sem.h>
+
+/*
+ * Block request queue in front of an ide device.
+ *
+ * Requests are moved straight between the device and the caller's memory.
+ * While the queue is plugged (blk_plug), writes are only queued, sorted by
+ * sector, and a write which continues a queued one on disk is merged into it:
+ * a request carries a list of memory segments, so the buffers need not be
+ * adjacent in memory. blk_unplug then dispatches the whole batch in one sweep
+ * across the disk. Reads are never queued, sorted or merged: pending writes
+ * are dispatched first so a read always sees the latest data, then the read
+ * goes straight to the device. The queue is serialized: the queue lock is held
+ * across dispatch, so at most one request is in flight at a time. The ide
+ * driver is synchronous (a ramdisk copy), there is no completion to wait for
+ * and so nothing that more requests in flight could overlap.
+ */
+
+#define BLK_NREQ                        64          /* max # of queued requests */
+#define BLK_NSEG                        8           /* max # of memory segments of a request */
+
+/* a part of a request which is contiguous in memory */
+struct blk_seg {
+    void *buf;                                      /* memory to Rd/Wr */
+    size_t nsecs;                                   /* # of sectors */
+};
+
+struct blk_request {
+    uint32_t secno;                                 /* first sector */
+    size_t nsecs;                                   /* # of sectors, split in MAX_NSECS pieces by blk_dispatch */
+    int nseg;                                       /* # of used entries of segs */
+    struct blk_seg segs[BLK_NSEG];                  /* the memory of the sectors, in disk order */
+    list_entry_t link;                              /* entry in the queue or the free list */
+};
+
+#define le2req(le, member)                          \
+    to_struct((le), struct blk_request, member)
+
+/* counters of a queue */
+struct blk_stat {
+    size_t submitted;                               /* requests submitted by callers */
+    size_t merged;                                  /* requests merged into a queued one */
+    size_t dispatched;                              /* requests sent to the device */
+};
+
+struct blk_queue {
+    unsigned short ideno;                           /* the ide device served */
+    int plugged;                                    /* nesting count of blk_plug */
+    list_entry_t queue;                             /* pending writes, sorted by secno */
+    list_entry_t free_list;                         /* unused entries of reqs */
+    semaphore_t sem;                                /* protects the queue */
+    struct blk_stat stat;
+    struct blk_request reqs[BLK_NREQ];
+};
+
+void blk_queue_init(struct blk_queue *q, unsigned short ideno);
+int blk_rw(struct blk_queue *q, uint32_t secno, void *buf, size_t nsecs, bool write);
+void blk_plug(struct blk_queue *q);
+int blk_unplug(struct blk_queue *q);
+void blk_print_stat(struct blk_queue *q, const char *name);
+
+#endif /* !__KERN_DRIVER_BLKQUEUE_H__ */
@@ -0,0 +1,361 @@
+#include <defs.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <list.h>
+#include <sem.h>
+#include <kmalloc.h>
+#include <dev.h>
+#include <iobuf.h>
+#include <clock.h>
+#include <bcache.h>
+#include <error.h>
+#include <assert.h>
+
+static list_entry_t hash_list[BCACHE_HASH_SIZE];
+static list_entry_t lru_list;
+static size_t nr_buf;
+static semaphore_t bcache_sem;
+static struct bcache_stat bstat;
+
+#define buf_hashfn(dev, blkno)                      \
+    (hash32((uint32_t)(uintptr_t)(dev) ^ (blkno), BCACHE_HASH_SHIFT))
+
+static void
+lock_bcache(void) {
+    down(&bcache_sem);
+}
+
+static void
+unlock_bcache(void) {
+    up(&bcache_sem);
+}
+
+void
+bcache_init(void) {
+    int i;
+    for (i = 0; i < BCACHE_HASH_SIZE; i ++) {
+        list_init(hash_list + i);
+    }
+    list_init(&lru_list);
+    nr_buf = 0;
+    memset(&bstat, 0, sizeof(bstat));
+    sem_init(&bcache_sem, 1);
+}
+
+/*
+ * buf_io_nolock - read/write the block held by @buf from/to its device.
+ */
+static int
+buf_io_nolock(struct buf *buf, bool write) {
+    struct iobuf __iob, *iob = iobuf_init(&__iob, buf->b_data, BCACHE_BLKSIZE, buf->b_blkno * BCACHE_BLKSIZE);
+    return dop_io(buf->b_dev, iob, write);
+}
+
+/*
+ * buf_writeback_nolock - write a dirty buffer back to disk and clear B_DIRTY.
+ */
+static int
+buf_writeback_nolock(struct buf *buf) {
+    int ret = 0;
+    if (buf->b_flags & B_DIRTY) {
+        if ((ret = buf_io_nolock(buf, 1)) == 0) {
+            buf->b_flags &= ~B_DIRTY;
+            bstat.writebacks ++;
+        }
+    }
+    return ret;
+}
+
+static struct buf *
+lookup_buf_nolock(struct device *dev, uint32_t blkno) {
+    list_entry_t *hash = hash_list + buf_hashfn(dev, blkno), *le = hash;
+    while ((le = list_next(le)) != hash) {
+        struct buf *buf = le2buf(le, hash_link);
+        if (buf->b_dev == dev && buf->b_blkno == blkno) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * alloc_buf_nolock - get an unused buffer head: allocate a new one while the cache
+ *                    is below BCACHE_NBUF, otherwise recycle the least recently
+ *                    used buffer nobody holds (writing it back first if dirty).
+ */
+static int
+alloc_buf_nolock(struct buf **buf_store) {
+    struct buf *buf;
+    if (nr_buf < BCACHE_NBUF) {
+        if ((buf = kmalloc(sizeof(struct buf))) == NULL) {
+            goto recycle;
+        }
+        if ((buf->b_data = kmalloc(BCACHE_BLKSIZE)) == NULL) {
+            kfree(buf);
+            goto recycle;
+        }
+        list_init(&(buf->hash_link));
+        list_add(&lru_list, &(buf->lru_link));
+        nr_buf ++;
+        goto found;
+    }
+
+recycle:
+    {
+        list_entry_t *le = &lru_list;
+        while ((le = list_prev(le)) != &lru_list) {
+            buf = le2buf(le, lru_link);
+            if (buf->b_ref == 0) {
+                int ret;
+                if ((ret = buf_writeback_nolock(buf)) != 0) {
+                    return ret;
+                }
+                list_del_init(&(buf->hash_link));
+                bstat.evictions ++;
+                goto found;
+            }
+        }
+    }
+    return -E_NO_MEM;
+
+found:
+    buf->b_flags = 0;
+    buf->b_ref = 0;
+    *buf_store = buf;
+    return 0;
+}
+
+/*
+ * bcache_getblk - find or create the buffer head of (dev, blkno) and take a reference.
+ * @read: if the block is not cached, fill it from disk
+ */
+static int
+bcache_getblk(struct device *dev, uint32_t blkno, bool read, struct buf **buf_store) {
+    assert(dev->d_blocksize == BCACHE_BLKSIZE && blkno < dev->d_blocks);
+    int ret = 0;
+    struct buf *buf;
+    lock_bcache();
+    {
+        if ((buf = lookup_buf_nolock(dev, blkno)) != NULL) {
+            if (read && !(buf->b_flags & B_VALID)) {
+                if ((ret = buf_io_nolock(buf, 0)) != 0) {
+                    goto out;
+                }
+                buf->b_flags |= B_VALID;
+            }
+            bstat.hits ++;
+        }
+        else {
+            if ((ret = alloc_buf_nolock(&buf)) != 0) {
+                goto out;
+            }
+            buf->b_dev = dev, buf->b_blkno = blkno;
+            if (read) {
+                if ((ret = buf_io_nolock(buf, 0)) != 0) {
+                    goto out;
+                }
+                buf->b_flags |= B_VALID;
+            }
+            list_add(hash_list + buf_hashfn(dev, blkno), &(buf->hash_link));
+            bstat.misses ++;
+        }
+        buf->b_ref ++;
+        list_del(&(buf->lru_link));
+        list_add(&lru_list, &(buf->lru_link));
+        *buf_store = buf;
+    }
+out:
+    unlock_bcache();
+    return ret;
+}
+
+/*
+ * bcache_read - get the buffer of (dev, blkno) with its content valid.
+ */
+int
+bcache_read(struct device *dev, uint32_t blkno, struct buf **buf_store) {
+    return bcache_getblk(dev, blkno, 1, buf_store);
+}
+
+/*
+ * bcache_get - get the buffer of (dev, blkno) without reading it from disk.
+ *              used when the caller is going to overwrite the whole block,
+ *              so the caller must fill b_data and call bcache_dirty.
+ */
+int
+bcache_get(struct device *dev, uint32_t blkno, struct buf **buf_store) {
+    return bcache_getblk(dev, blkno, 0, buf_store);
+}
+
+/*
+ * bcache_dirty - the content of @buf has been modified by its holder.
+ */
+void
+bcache_dirty(struct buf *buf) {
+    assert(buf->b_ref > 0);
+    if (!(buf->b_flags & B_DIRTY)) {
+        buf->b_dirty_time = ticks;
+    }
+    buf->b_flags |= B_VALID | B_DIRTY;
+}
+
+/*
+ * bcache_release - drop the reference taken by bcache_read/bcache_get.
+ */
+void
+bcache_release(struct buf *buf) {
+    lock_bcache();
+    {
+        assert(buf->b_ref > 0);
+        buf->b_ref --;
+    }
+    unlock_bcache();
+}
+
+/*
+ * bcache_io_direct - Rd/Wr @nblks blocks straight between @data and @dev, without caching them.
+ *                    used for file data, which is cached by the page cache instead.
+ *                    cached copies of these blocks (if any) are kept coherent: a read
+ *                    returns the cached content, a write refreshes the cached copy.
+ */
+int
+bcache_io_direct(struct device *dev, void *data, uint32_t blkno, uint32_t nblks, bool write) {
+    assert(dev->d_blocksize == BCACHE_BLKSIZE && blkno + nblks <= dev->d_blocks);
+    int ret;
+    lock_bcache();
+    {
+        struct iobuf __iob, *iob = iobuf_init(&__iob, data, nblks * BCACHE_BLKSIZE, blkno * BCACHE_BLKSIZE);
+        if ((ret = dop_io(dev, iob, write)) != 0) {
+            goto out;
+        }
+        uint32_t i;
+        for (i = 0; i < nblks; i ++, data += BCACHE_BLKSIZE) {
+            struct buf *buf;
+            if ((buf = lookup_buf_nolock(dev, blkno + i)) == NULL) {
+                continue;
+            }
+            if (write) {
+                memcpy(buf->b_data, data, BCACHE_BLKSIZE);
+                buf->b_flags = (buf->b_flags | B_VALID) & ~B_DIRTY;
+            }
+            else if (buf->b_flags & B_VALID) {
+                memcpy(data, buf->b_data, BCACHE_BLKSIZE);
+            }
+        }
+    }
+out:
+    unlock_bcache();
+    return ret;
+}
+
+/*
+ * bcache_sync - write all dirty buffers of @dev back to disk.
+ */
+int
+bcache_sync(struct device *dev) {
+    int ret = 0;
+    lock_bcache();
+    dop_ioctl(dev, DEV_IOCTL_PLUG, NULL);
+    {
+        list_entry_t *le = &lru_list;
+        while ((le = list_prev(le)) != &lru_list) {
+            struct buf *buf = le2buf(le, lru_link);
+            if (buf->b_dev == dev) {
+                int err;
+                if ((err = buf_writeback_nolock(buf)) != 0 && ret == 0) {
+                    ret = err;
+                }
+            }
+        }
+    }
+    dop_ioctl(dev, DEV_IOCTL_UNPLUG, NULL);
+    unlock_bcache();
+    return ret;
+}
+
+/*
+ * bcache_writeback - background writeback of dirty buffers of all devices:
+ *                    the buffers dirty for at least @expire ticks, or all of them
+ *                    if more than @ratio percent of the cache is dirty.
+ *                    buffers are written oldest first, so that repeated updates to the
+ *                    same metadata block in between are merged into a single write.
+ */
+int
+bcache_writeback(size_t expire, size_t ratio) {
+    int ret = 0;
+    lock_bcache();
+    {
+        size_t nr_dirty = 0;
+        list_entry_t *le = &lru_list;
+        while ((le = list_prev(le)) != &lru_list) {
+            if (le2buf(le, lru_link)->b_flags & B_DIRTY) {
+                nr_dirty ++;
+            }
+        }
+        bool all = (nr_dirty * 100 > ratio * BCACHE_NBUF);
+        struct device *plugged = NULL;
+        while (nr_dirty != 0 && (le = list_prev(le)) != &lru_list) {
+            struct buf *buf = le2buf(le, lru_link);
+            if (!(buf->b_flags & B_DIRTY)) {
+                continue;
+            }
+            nr_dirty --;
+            if (all || ticks - buf->b_dirty_time >= expire) {
+                if (buf->b_dev != plugged) {
+                    // let the device sort and merge the writes of each device
+                    if (plugged != NULL) {
+                        dop_ioctl(plugged, DEV_IOCTL_UNPLUG, NULL);
+                    }
+                    plugged = buf->b_dev;
+                    dop_ioctl(plugged, DEV_IOCTL_PLUG, NULL);
+                }
+                int err;
+                if ((err = buf_writeback_nolock(buf)) != 0 && ret == 0) {
+                    ret = err;
+                }
+            }
+        }
+        if (plugged != NULL) {
+            dop_ioctl(plugged, DEV_IOCTL_UNPLUG, NULL);
+        }
+    }
+    unlock_bcache();
+    return ret;
+}
+
+/*
+ * bcache_invalidate - forget all cached blocks of @dev, called on unmount
+ *                     after bcache_sync. no buffer of @dev may be held.
+ */
+void
+bcache_invalidate(struct device *dev) {
+    lock_bcache();
+    {
+        list_entry_t *le = list_next(&lru_list);
+        while (le != &lru_list) {
+            struct buf *buf = le2buf(le, lru_link);
+            le = list_next(le);
+            if (buf->b_dev == dev) {
+                assert(buf->b_ref == 0 && !(buf->b_flags & B_DIRTY));
+                list_del(&(buf->hash_link));
+                list_del(&(buf->lru_link));
+                kfree(buf->b_data);
+                kfree(buf);
+                nr_buf --;
+            }
+        }
+    }
+    unlock_bcache();
+}
+
+void
+bcache_get_stat(struct bcache_stat *stat) {
+    *stat = bstat;
+}
+
+void
+bcache_print_stat(void) {
+    cprintf("bcache: %d/%d buffers, hits %d, misses %d, evictions %d, writebacks %d.\n",
+            nr_buf, BCACHE_NBUF, bstat.hits, bstat.misses, bstat.evictions, bstat.writebacks);
+}
@@ -0,0 +1,62 @@
+#ifndef __KERN_FS_BCACHE_H__
+#define __KERN_FS_BCACHE_H__
+
+#include <defs.h>
+#include <mmu.h>
+#include <list.h>
+
+struct device;
+
+/*
+ * Block buffer cache, sitting between the file system and the block device.
+ *
+ * Every cached block is described by a buffer head keyed by (device, blkno).
+ * Heads live in a hash table for lookup and on one LRU list for eviction;
+ * a head with b_ref != 0 is in use and is never evicted. Writes only mark
+ * the buffer dirty, dirty buffers reach the disk on bcache_sync, when they
+ * are evicted, or when the writeback daemon finds them old enough.
+ */
+
+#define BCACHE_BLKSIZE                  PGSIZE      /* size of a cached block */
+#define BCACHE_NBUF                     128         /* max # of cached blocks */
+#define BCACHE_HASH_SHIFT               7
+#define BCACHE_HASH_SIZE                (1 << BCACHE_HASH_SHIFT)
+
+#define B_VALID                         0x1         /* b_data holds the block content */
+#define B_DIRTY                         0x2         /* b_data is newer than the disk */
+
+struct buf {
+    struct device *b_dev;                           /* device the block lives on */
+    uint32_t b_blkno;                               /* NO. of the block on b_dev */
+    uint32_t b_flags;                               /* B_VALID | B_DIRTY */
+    int b_ref;                                      /* # of users holding this buffer */
+    size_t b_dirty_time;                            /* ticks when the buffer became dirty */
+    void *b_data;                                   /* BCACHE_BLKSIZE bytes of block data */
+    list_entry_t hash_link;                         /* entry in the hash chain */
+    list_entry_t lru_link;                          /* entry in the lru list, most recent first */
+};
+
+#define le2buf(le, member)                          \
+    to_struct((le), struct buf, member)
+
+/* counters used to size the cache */
+struct bcache_stat {
+    size_t hits;                                    /* lookups served from memory */
+    size_t misses;                                  /* lookups which had to read the disk */
+    size_t evictions;                               /* buffers recycled for another block */
+    size_t writebacks;                              /* dirty buffers written to disk */
+};
+
+void bcache_init(void);
+int bcache_read(struct device *dev, uint32_t blkno, struct buf **buf_store);
+int bcache_get(struct device *dev, uint32_t blkno, struct buf **buf_store);
+void bcache_dirty(struct buf *buf);
+void bcache_release(struct buf *buf);
+int bcache_io_direct(struct device *dev, void *data, uint32_t blkno, uint32_t nblks, bool write);
+int bcache_sync(struct device *dev);
+int bcache_writeback(size_t expire, size_t ratio);
+void bcache_invalidate(struct device *dev);
+void bcache_get_stat(struct bcache_stat *stat);
+void bcache_print_stat(void);
+
+#endif /* !__KERN_FS_BCACHE_H__ */
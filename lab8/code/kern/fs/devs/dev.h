@@ -25,6 +25,11 @@ struct device {
 #define dop_io(dev, iob, write)             ((dev)->d_io(dev, iob, write))
 #define dop_ioctl(dev, op, data)            ((dev)->d_ioctl(dev, op, data))
 
+/* ioctl ops of block devices, other devices return -E_UNIMP */
+#define DEV_IOCTL_PLUG                      1   // hold writes back to sort and merge them ...
+#define DEV_IOCTL_UNPLUG                    2   // ... until the matching unplug, which writes them all
+#define DEV_IOCTL_PRINT_STAT                3   // report the counters of the request queue
+
 void dev_init(void);
 struct inode *dev_create_inode(void);
 
@@ -1,9 +1,8 @@
 #include <defs.h>
 #include <mmu.h>
-#include <sem.h>
 #include <ide.h>
+#include <blkqueue.h>
 #include <inode.h>
-#include <kmalloc.h>
 #include <dev.h>
 #include <vfs.h>
 #include <iobuf.h>
@@ -11,21 +10,9 @@
 #include <assert.h>
 
 #define DISK0_BLKSIZE                   PGSIZE
-#define DISK0_BUFSIZE                   (4 * DISK0_BLKSIZE)
 #define DISK0_BLK_NSECT                 (DISK0_BLKSIZE / SECTSIZE)
 
-static char *disk0_buffer;
-static semaphore_t disk0_sem;
-
-static void
-lock_disk0(void) {
-    down(&(disk0_sem));
-}
-
-static void
-unlock_disk0(void) {
-    up(&(disk0_sem));
-}
+static struct blk_queue disk0_queue;
 
 static int
 disk0_open(struct device *dev, uint32_t open_flags) {
@@ -38,28 +25,7 @@ disk0_close(struct device *dev) {
 }
 
 //mark 封装了一下ramdisk的接口，每次读取或者写入若干个block。
-
-
-
-static void
-disk0_read_blks_nolock(uint32_t blkno, uint32_t nblks) {
-    int ret;
-    uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_read_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
-        panic("disk0: read blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-                blkno, sectno, nblks, nsecs, ret);
-    }
-}
-
-static void
-disk0_write_blks_nolock(uint32_t blkno, uint32_t nblks) {
-    int ret;
-    uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_write_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
-        panic("disk0: write blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-                blkno, sectno, nblks, nsecs, ret);
-    }
-}
+//数据直接在iobuf和磁盘之间搬运, 请求经过disk0_queue排序/合并
 
 static int
 disk0_io(struct device *dev, struct iobuf *iob, bool write) {
@@ -83,32 +49,32 @@ disk0_io(struct device *dev, struct iobuf *iob, bool write) {
         return 0;
     }
 
-    lock_disk0();
-    while (resid != 0) {
-        size_t copied, alen = DISK0_BUFSIZE;
-        if (write) {
-            iobuf_move(iob, disk0_buffer, alen, 0, &copied);
-            assert(copied != 0 && copied <= resid && copied % DISK0_BLKSIZE == 0);
-            nblks = copied / DISK0_BLKSIZE;
-            disk0_write_blks_nolock(blkno, nblks);
-        }
-        else {
-            if (alen > resid) {
-                alen = resid;
-            }
-            nblks = alen / DISK0_BLKSIZE;
-            disk0_read_blks_nolock(blkno, nblks);
-            iobuf_move(iob, disk0_buffer, alen, 1, &copied);
-            assert(copied == alen && copied % DISK0_BLKSIZE == 0);
-        }
-        resid -= copied, blkno += nblks;
+    int ret;
+    uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
+    if ((ret = blk_rw(&disk0_queue, sectno, iob->io_base, nsecs, write)) != 0) {
+        panic("disk0: %s blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
+                write ? "write" : "read", blkno, sectno, nblks, nsecs, ret);
     }
-    unlock_disk0();
+    iobuf_skip(iob, resid);
     return 0;
 }
 
 static int
 disk0_ioctl(struct device *dev, int op, void *data) {
+    int ret;
+    switch (op) {
+    case DEV_IOCTL_PLUG:
+        blk_plug(&disk0_queue);
+        return 0;
+    case DEV_IOCTL_UNPLUG:
+        if ((ret = blk_unplug(&disk0_queue)) != 0) {
+            panic("disk0: unplug: 0x%08x.\n", ret);
+        }
+        return 0;
+    case DEV_IOCTL_PRINT_STAT:
+        blk_print_stat(&disk0_queue, "disk0");
+        return 0;
+    }
     return -E_UNIMP;
 }
 
@@ -124,12 +90,7 @@ disk0_device_init(struct device *dev) {
     dev->d_close = disk0_close;
     dev->d_io = disk0_io;
     dev->d_ioctl = disk0_ioctl;
-    sem_init(&(disk0_sem), 1);
-
-    static_assert(DISK0_BUFSIZE % DISK0_BLKSIZE == 0);
-    if ((disk0_buffer = kmalloc(DISK0_BUFSIZE)) == NULL) {
-        panic("disk0 alloc buffer failed.\n");
-    }
+    blk_queue_init(&disk0_queue, DISK0_DEV_NO);
 }
 
 void
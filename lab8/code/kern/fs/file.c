@@ -108,12 +108,20 @@ fd_array_close(struct file *file) {
     }
 }
 
+// file_ra_reset - forget the readahead history of file, the next read at pos counts as sequential
+static void
+file_ra_reset(struct file *file, off_t pos) {
+    file->ra_next = file->ra_end = pos;
+    file->ra_pages = 0;
+}
+
 //fs_array_dup - duplicate file 'from'  to file 'to'
 void
 fd_array_dup(struct file *to, struct file *from) {
     //cprintf("[fd_array_dup]from fd=%d, to fd=%d\n",from->fd, to->fd);
     assert(to->status == FD_INIT && from->status == FD_OPENED);
     to->pos = from->pos;
+    file_ra_reset(to, to->pos);
     to->readable = from->readable;
     to->writable = from->writable;
     struct inode *node = from->node;
@@ -194,6 +202,7 @@ file_open(char *path, uint32_t open_flags) {
         }
         file->pos = stat->st_size;//追加写模式，设置当前位置为文件尾
     }
+    file_ra_reset(file, file->pos);
     file->node = node;
     file->readable = readable;
     file->writable = writable;
@@ -213,6 +222,37 @@ file_close(int fd) {
     return 0;
 }
 
+/*
+ * file_readahead - 读完[pos, pos + len)后更新文件的预读状态:
+ *                  顺序读时预读窗口翻倍(不超过FILE_RA_MAX_PAGES), 随机读时窗口清零;
+ *                  当已预读的数据被读掉一半时, 把窗口内后续的块预读到缓存中
+ */
+static void
+file_readahead(struct file *file, off_t pos, size_t len) {
+    off_t end = pos + len;
+    if (pos != file->ra_next) {
+        file_ra_reset(file, end);
+        return;
+    }
+    if (file->ra_pages == 0) {
+        file->ra_pages = FILE_RA_MIN_PAGES;
+    }
+    else if ((file->ra_pages *= 2) > FILE_RA_MAX_PAGES) {
+        file->ra_pages = FILE_RA_MAX_PAGES;
+    }
+    file->ra_next = end;
+
+    off_t ra_size = file->ra_pages * PGSIZE;
+    if (file->ra_end < end) {
+        file->ra_end = end;
+    }
+    if (file->ra_end - end < ra_size / 2) {
+        // prefetch is only a hint, errors are ignored
+        vop_readahead(file->node, file->ra_end, end + ra_size - file->ra_end);
+        file->ra_end = end + ra_size;
+    }
+}
+
 // read file
 /*
 函数有4个参数，
@@ -238,6 +278,9 @@ file_read(int fd, void *base, size_t len, size_t *copied_store) {
     ret = vop_read(file->node, iob);//调用vop_read函数将文件内容读到iob中
 
     size_t copied = iobuf_used(iob);
+    if (ret == 0 && copied != 0 && file->node->in_ops->vop_readahead != NULL) {
+        file_readahead(file, file->pos, copied);
+    }
     if (file->status == FD_OPENED) {
         file->pos += copied;//调整文件指针偏移量pos的值，使其向后移动实际读到的字节数iobuf_used(iob)
     }
@@ -296,6 +339,9 @@ file_seek(int fd, off_t pos, int whence) {
 
     if (ret == 0) {
         if ((ret = vop_tryseek(file->node, pos)) == 0) {
+            if (pos != file->ra_next) {
+                file_ra_reset(file, pos);
+            }
             file->pos = pos;
         }
 //    cprintf("file_seek, pos=%d, whence=%d, ret=%d\n", pos, whence, ret);
@@ -332,6 +378,21 @@ file_fsync(int fd) {
     return ret;
 }
 
+/*
+ * file_getinode - get the inode of the opened file @fd, e.g. to map the file.
+ *                 NOTICE: no reference is taken, the inode is valid while @fd is open.
+ */
+int
+file_getinode(int fd, struct inode **node_store) {
+    int ret;
+    struct file *file;
+    if ((ret = fd2file(fd, &file)) != 0) {
+        return ret;
+    }
+    *node_store = file->node;
+    return 0;
+}
+
 // get file entry in DIR
 int
 file_getdirentry(int fd, struct dirent *direntp) {
@@ -22,8 +22,14 @@ struct file {
     off_t pos;                        //访问文件的当前位置
     struct inode *node;               //该文件对应的内存inode指针
     int open_count;                   //打开此文件的次数
+    off_t ra_next;                    //预读: 顺序读时下一次读应开始的位置
+    off_t ra_end;                     //预读: 已经预读到的位置
+    size_t ra_pages;                  //预读窗口的大小(页数), 为0表示不预读
 };
 
+#define FILE_RA_MIN_PAGES                          4        //顺序读开始时的预读窗口
+#define FILE_RA_MAX_PAGES                          64       //预读窗口的上限
+
 void fd_array_init(struct file *fd_array);
 void fd_array_open(struct file *file);
 void fd_array_close(struct file *file);
@@ -37,6 +43,7 @@ int file_write(int fd, void *base, size_t len, size_t *copied_store);
 int file_seek(int fd, off_t pos, int whence);
 int file_fstat(int fd, struct stat *stat);
 int file_fsync(int fd);
+int file_getinode(int fd, struct inode **node_store);
 int file_getdirentry(int fd, struct dirent *dirent);
 int file_dup(int fd1, int fd2);
 int file_pipe(int fd[]);
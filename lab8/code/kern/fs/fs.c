@@ -6,11 +6,13 @@
 #include <file.h>
 #include <sfs.h>
 #include <inode.h>
+#include <bcache.h>
 #include <assert.h>
 //called when init_main proc start
 void
 fs_init(void) {
     vfs_init();
+    bcache_init();
     dev_init();
     sfs_init();
 }
@@ -11,9 +11,34 @@
 struct bitmap {
     uint32_t nbits;
     uint32_t nwords;
+    uint32_t hint;          // next-fit: the word where the next search starts
     WORD_TYPE *map;
 };
 
+// bitmap_ctz - count trailing zeros of a non-zero word, i.e. the offset of its lowest set bit
+static inline uint32_t
+bitmap_ctz(WORD_TYPE word) {
+    static_assert(sizeof(WORD_TYPE) == 4);
+    assert(word != 0);
+    uint32_t n = 0;
+    if ((word & 0xFFFF) == 0) {
+        n += 16, word >>= 16;
+    }
+    if ((word & 0xFF) == 0) {
+        n += 8, word >>= 8;
+    }
+    if ((word & 0xF) == 0) {
+        n += 4, word >>= 4;
+    }
+    if ((word & 0x3) == 0) {
+        n += 2, word >>= 2;
+    }
+    if ((word & 0x1) == 0) {
+        n += 1;
+    }
+    return n;
+}
+
 // bitmap_create - allocate a new bitmap object.
 struct bitmap *
 bitmap_create(uint32_t nbits) {
@@ -32,7 +57,7 @@ bitmap_create(uint32_t nbits) {
         return NULL;
     }
 
-    bitmap->nbits = nbits, bitmap->nwords = nwords;
+    bitmap->nbits = nbits, bitmap->nwords = nwords, bitmap->hint = 0;
     bitmap->map = memset(map, 0xFF, sizeof(WORD_TYPE) * nwords);
 
     /* mark any leftover bits at the end in use(0) */
@@ -50,26 +75,98 @@ bitmap_create(uint32_t nbits) {
 }
 
 // bitmap_alloc - locate a cleared bit, set it, and return its index.
+//                (a word at a time, starting from the word of the last allocation)
 int
 bitmap_alloc(struct bitmap *bitmap, uint32_t *index_store) {
     WORD_TYPE *map = bitmap->map;
-    uint32_t ix, offset, nwords = bitmap->nwords;
-    for (ix = 0; ix < nwords; ix ++) {
+    uint32_t i, ix = bitmap->hint, nwords = bitmap->nwords;
+    for (i = 0; i < nwords; i ++, ix ++) {
+        if (ix == nwords) {
+            ix = 0;
+        }
         if (map[ix] != 0) {
-            for (offset = 0; offset < WORD_BITS; offset ++) {
-                WORD_TYPE mask = (1 << offset);
-                if (map[ix] & mask) {
-                    map[ix] ^= mask;
-                    *index_store = ix * WORD_BITS + offset;
-                    return 0;
-                }
-            }
-            assert(0);
+            uint32_t offset = bitmap_ctz(map[ix]);
+            map[ix] ^= ((WORD_TYPE)1 << offset);
+            bitmap->hint = ix;
+            *index_store = ix * WORD_BITS + offset;
+            return 0;
         }
     }
     return -E_NO_MEM;
 }
 
+// bitmap_next_free - find the first free(1) bit in [index, end), return end if there is none
+static uint32_t
+bitmap_next_free(struct bitmap *bitmap, uint32_t index, uint32_t end) {
+    if (index >= end) {
+        return end;
+    }
+    uint32_t ix = index / WORD_BITS;
+    WORD_TYPE word = bitmap->map[ix] & ((WORD_TYPE)-1 << (index % WORD_BITS));
+    while (word == 0) {
+        if (++ ix * WORD_BITS >= end) {
+            return end;
+        }
+        word = bitmap->map[ix];
+    }
+    index = ix * WORD_BITS + bitmap_ctz(word);
+    return (index < end) ? index : end;
+}
+
+// bitmap_next_used - find the first used(0) bit in [index, end), return end if there is none
+static uint32_t
+bitmap_next_used(struct bitmap *bitmap, uint32_t index, uint32_t end) {
+    if (index >= end) {
+        return end;
+    }
+    uint32_t ix = index / WORD_BITS;
+    WORD_TYPE word = ~bitmap->map[ix] & ((WORD_TYPE)-1 << (index % WORD_BITS));
+    while (word == 0) {
+        if (++ ix * WORD_BITS >= end) {
+            return end;
+        }
+        word = ~bitmap->map[ix];
+    }
+    index = ix * WORD_BITS + bitmap_ctz(word);
+    return (index < end) ? index : end;
+}
+
+// bitmap_find_range - find n free bits in a row inside [start, end)
+static bool
+bitmap_find_range(struct bitmap *bitmap, uint32_t start, uint32_t end, uint32_t n, uint32_t *index_store) {
+    while ((start = bitmap_next_free(bitmap, start, end)) < end) {
+        uint32_t limit = (end - start > n) ? start + n : end;
+        uint32_t used = bitmap_next_used(bitmap, start, limit);
+        if (used - start == n) {
+            *index_store = start;
+            return 1;
+        }
+        start = used;
+    }
+    return 0;
+}
+
+// bitmap_alloc_range - locate n cleared bits in a row, set them, and return the index of the first one.
+int
+bitmap_alloc_range(struct bitmap *bitmap, uint32_t n, uint32_t *index_store) {
+    assert(n != 0);
+    uint32_t index, from = bitmap->hint * WORD_BITS;
+    if (!bitmap_find_range(bitmap, from, bitmap->nbits, n, &index)) {
+        uint32_t end = (from + n - 1 < bitmap->nbits) ? from + n - 1 : bitmap->nbits;
+        if (!bitmap_find_range(bitmap, 0, end, n, &index)) {
+            return -E_NO_MEM;
+        }
+    }
+    uint32_t i;
+    for (i = 0; i < n; i ++) {
+        uint32_t ix = (index + i) / WORD_BITS, offset = (index + i) % WORD_BITS;
+        bitmap->map[ix] ^= ((WORD_TYPE)1 << offset);
+    }
+    bitmap->hint = (index + n - 1) / WORD_BITS;
+    *index_store = index;
+    return 0;
+}
+
 // bitmap_translate - according index, get the related word and mask
 static void
 bitmap_translate(struct bitmap *bitmap, uint32_t index, WORD_TYPE **word, WORD_TYPE *mask) {
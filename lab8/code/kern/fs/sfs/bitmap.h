@@ -12,6 +12,8 @@
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *     bitmap_alloc_range - locate N cleared bits in a row, set them, and
+ *                      return the index of the first one.
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
  *     bitmap_isset   - return whether a particular bit is set or not.
@@ -23,6 +25,7 @@ struct bitmap;
 
 struct bitmap *bitmap_create(uint32_t nbits);                     // allocate a new bitmap object.
 int bitmap_alloc(struct bitmap *bitmap, uint32_t *index_store);   // locate a cleared bit, set it, and return its index.
+int bitmap_alloc_range(struct bitmap *bitmap, uint32_t n, uint32_t *index_store); // locate n cleared bits in a row, set them, return the first index.
 bool bitmap_test(struct bitmap *bitmap, uint32_t index);          // return whether a particular bit is set or not.
 void bitmap_free(struct bitmap *bitmap, uint32_t index);          // according index, set related bit to 1
 void bitmap_destroy(struct bitmap *bitmap);                       // free memory contains bitmap
@@ -18,6 +18,7 @@
 void
 sfs_init(void) {
     int ret;
+    sfs_inode_cache_init();
     if ((ret = sfs_mount("disk0")) != 0) {
         panic("failed: sfs: sfs_mount: %e.\n", ret);
     }
@@ -6,6 +6,7 @@
 #include <list.h>
 #include <sem.h>
 #include <unistd.h>
+#include <pcache.h>
 
 /*
  * Simple FS (SFS) definitions visible to ucore. This covers the on-disk format
@@ -96,6 +97,10 @@ struct sfs_inode {
     semaphore_t sem;                                /* din 的信号量 */
     list_entry_t inode_link;                        /* 在 sfs_fs 中链接列表的条目 */
     list_entry_t hash_link;                         /* 在 sfs_fs 中哈希链接列表的条目 */
+    struct pcache pcache;                           /* 文件数据的页缓存, 以文件内的块索引为键 */
+    uint32_t resv_start;                            /* 为文件末尾预留的连续磁盘块的起始块号 */
+    uint32_t resv_blocks;                           /* 预留块中尚未使用的块数 */
+    struct sfs_dirindex *dirindex;                  /* 目录的内存名字索引, 第一次查找时建立, NULL表示还没有 */
 };
 
 
@@ -121,6 +126,13 @@ struct sfs_fs {
 #define SFS_HLIST_SIZE                              (1 << SFS_HLIST_SHIFT)
 #define sin_hashfn(x)                               (hash32(x, SFS_HLIST_SHIFT))
 
+/* hash of the in-memory name index of a directory */
+#define SFS_DIRINDEX_SHIFT                          7
+#define SFS_DIRINDEX_SIZE                           (1 << SFS_DIRINDEX_SHIFT)
+
+/* max # of blocks moved by one multi-block request of file data */
+#define SFS_IO_MAX_RUN                              64
+
 /* size of freemap (in bits) */
 #define sfs_freemap_bits(super)                     ROUNDUP((super)->blocks, SFS_BLKBITS)
 
@@ -129,8 +141,10 @@ struct sfs_fs {
 
 struct fs;
 struct inode;
+struct sfs_dirindex;
 
 void sfs_init(void);
+void sfs_inode_cache_init(void);
 int sfs_mount(const char *devname);
 
 void lock_sfs_fs(struct sfs_fs *sfs);
@@ -140,11 +154,14 @@ void unlock_sfs_io(struct sfs_fs *sfs);
 
 int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
+int sfs_rblock_direct(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
+int sfs_wblock_direct(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
 int sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
 int sfs_sync_super(struct sfs_fs *sfs);
 int sfs_sync_freemap(struct sfs_fs *sfs);
 int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
+int sfs_sync_buffers(struct sfs_fs *sfs);
 
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino);
 
@@ -10,14 +10,17 @@
 #include <inode.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <bcache.h>
 #include <error.h>
 #include <assert.h>
 #include <proc.h>
 /*
- * sfs_sync - sync sfs's superblock and freemap in memroy into disk
+ * sfs_writeback - write the dirty file data of all inodes into disk, and sync
+ *                 sfs's inodes, superblock and freemap in memroy into the buffer cache,
+ *                 where they are left for bcache_writeback to write them later
  */
 static int
-sfs_sync(struct fs *fs) {
+sfs_writeback(struct fs *fs) {
     struct sfs_fs *sfs = fsop_info(fs, sfs);
     lock_sfs_fs(sfs);
     {
@@ -44,6 +47,19 @@ sfs_sync(struct fs *fs) {
     return 0;
 }
 
+/*
+ * sfs_sync - sync sfs's inodes, superblock and freemap in memroy into the buffer cache,
+ *            then write the dirty cached blocks into disk
+ */
+static int
+sfs_sync(struct fs *fs) {
+    int ret;
+    if ((ret = sfs_writeback(fs)) != 0) {
+        return ret;
+    }
+    return sfs_sync_buffers(fsop_info(fs, sfs));
+}
+
 /*
  * sfs_get_root - get the root directory inode  from disk (SFS_BLKN_ROOT,1)
  */
@@ -67,6 +83,7 @@ sfs_unmount(struct fs *fs) {
         return -E_BUSY;
     }
     assert(!sfs->super_dirty);
+    bcache_invalidate(sfs->dev);
     bitmap_destroy(sfs->freemap);
     kfree(sfs->sfs_buffer);
     kfree(sfs->hash_list);
@@ -94,6 +111,8 @@ sfs_cleanup(struct fs *fs) {
     if (ret != 0) {
         warn("sfs: sync error: '%s': %e.\n", sfs->super.info, ret);
     }
+    bcache_print_stat();
+    dop_ioctl(sfs->dev, DEV_IOCTL_PRINT_STAT, NULL);
 }
 
 /*
@@ -234,6 +253,7 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
 
     /* link addr of sync/get_root/unmount/cleanup funciton  fs's function pointers*/
     fs->fs_sync = sfs_sync;
+    fs->fs_writeback = sfs_writeback;
     fs->fs_get_root = sfs_get_root;
     fs->fs_unmount = sfs_unmount;
     fs->fs_cleanup = sfs_cleanup;
@@ -4,11 +4,14 @@
 #include <list.h>
 #include <stat.h>
 #include <kmalloc.h>
+#include <slab.h>
 #include <vfs.h>
 #include <dev.h>
 #include <sfs.h>
 #include <inode.h>
 #include <iobuf.h>
+#include <pmm.h>
+#include <pcache.h>
 #include <bitmap.h>
 #include <error.h>
 #include <assert.h>
@@ -109,6 +112,64 @@ sfs_block_free(struct sfs_fs *sfs, uint32_t ino) {
     sfs->super.unused_blocks ++, sfs->super_dirty = 1;
 }
 
+/*
+ * sfs_bmap_unreserve_nolock - 归还预留但没有用上的块
+ */
+static void
+sfs_bmap_unreserve_nolock(struct sfs_fs *sfs, struct sfs_inode *sin) {
+    while (sin->resv_blocks != 0) {
+        sfs_block_free(sfs, sin->resv_start ++);
+        sin->resv_blocks --;
+    }
+}
+
+/*
+ * sfs_bmap_reserve_nolock - 文件即将在末尾增长nblks个块时, 用bitmap_alloc_range一次预留一段连续的空闲块,
+ *                           之后sfs_bmap_get_nolock分配数据块时优先从中取, 使追加的数据在磁盘上连续.
+ *                           空闲空间不够连续时逐次减半, 实在找不到就退回逐块分配.
+ * @clear: 预留块是否要清零. 写路径上新块的内容总是由页缓存中清零过的页给出, 无需清零.
+ */
+static void
+sfs_bmap_reserve_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t nblks, bool clear) {
+    assert(sin->resv_blocks == 0);
+    for (; nblks > 1; nblks /= 2) {
+        if (bitmap_alloc_range(sfs->freemap, nblks, &(sin->resv_start)) == 0) {
+            assert(sfs->super.unused_blocks >= nblks);
+            sfs->super.unused_blocks -= nblks, sfs->super_dirty = 1;
+            sin->resv_blocks = nblks;
+            if (clear && sfs_clear_block(sfs, sin->resv_start, nblks) != 0) {
+                sfs_bmap_unreserve_nolock(sfs, sin);
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * sfs_block_alloc_data - 为文件分配一个数据块, 有预留块时直接取下一个预留块
+ */
+static int
+sfs_block_alloc_data(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t *ino_store) {
+    if (sin->resv_blocks != 0) {
+        *ino_store = sin->resv_start ++;
+        sin->resv_blocks --;
+        return 0;
+    }
+    return sfs_block_alloc(sfs, ino_store);
+}
+
+static struct kmem_cache *sfs_din_cachep;
+
+/*
+ * sfs_inode_cache_init - create the cache the in-memory copies of disk inodes come from
+ */
+void
+sfs_inode_cache_init(void) {
+    if ((sfs_din_cachep = kmem_cache_create("sfs_disk_inode", sizeof(struct sfs_disk_inode), NULL)) == NULL) {
+        panic("cannot create sfs_disk_inode cache.\n");
+    }
+}
+
 /*
  * sfs_create_inode - alloc a inode in memroy, and init din/ino/dirty/reclian_count/sem fields in sfs_inode in inode
  */
@@ -120,6 +181,9 @@ sfs_create_inode(struct sfs_fs *sfs, struct sfs_disk_inode *din, uint32_t ino, s
         struct sfs_inode *sin = vop_info(node, sfs_inode);
         sin->din = din, sin->ino = ino, sin->dirty = 0, sin->reclaim_count = 1;
         sem_init(&(sin->sem), 1);
+        pcache_init_mapping(&(sin->pcache));
+        sin->resv_start = sin->resv_blocks = 0;
+        sin->dirindex = NULL;
         *node_store = node;
         return 0;
     }
@@ -162,7 +226,7 @@ sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino) {
 
     int ret = -E_NO_MEM;
     struct sfs_disk_inode *din;
-    if ((din = kmalloc(sizeof(struct sfs_disk_inode))) == NULL) {
+    if ((din = kmem_cache_alloc(sfs_din_cachep)) == NULL) {
         goto failed_unlock;
     }
 
@@ -183,7 +247,7 @@ out_unlock:
     return 0;
 
 failed_cleanup_din:
-    kfree(din);
+    kmem_cache_free(sfs_din_cachep, din);
 failed_unlock:
     unlock_sfs_fs(sfs);
     return ret;
@@ -200,7 +264,7 @@ failed_unlock:
  * @ino_store: 0或已使用块的索引或新分配的块的索引。
  */
 static int
-sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t *entp, uint32_t index, bool create, uint32_t *ino_store) {
+sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t *entp, uint32_t index, bool create, uint32_t *ino_store) {
     assert(index < SFS_BLK_NENTRY);
     int ret;
     uint32_t ent, ino = 0;
@@ -224,7 +288,7 @@ sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t *entp, uint32_t index, bool
         }
     }
     
-    if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {//给找到的索引号分配一个4k的空间
+    if ((ret = sfs_block_alloc_data(sfs, sin, &ino)) != 0) {//给找到的索引号分配一个4k的空间
         goto failed_cleanup;
     }
     if ((ret = sfs_wbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
@@ -264,7 +328,7 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, b
 	// index位于前 SFS_NDIRECT 个直接块内,说明是直接索引的部分
     if (index < SFS_NDIRECT) {
         if ((ino = din->direct[index]) == 0 && create) {//index索引的是一个无效索引,且需要重新分配硬盘上的一个4k空间
-            if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {//如果不为0,说明分配失败
+            if ((ret = sfs_block_alloc_data(sfs, sin, &ino)) != 0) {//如果不为0,说明分配失败
                 return ret;
             }
             din->direct[index] = ino;//把分配下来的4k空间的索引号存入direct[index]中
@@ -276,7 +340,7 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, b
     index -= SFS_NDIRECT;//间接索引块计数算上了直接那部分,所以要先把直接那部分减下去
     if (index < SFS_BLK_NENTRY) {//小于间接索引块的数量,说明是间接索引块的部分
         ent = din->indirect;//取出间接索引块的索引号
-        if ((ret = sfs_bmap_get_sub_nolock(sfs, &ent, index, create, &ino)) != 0) {
+        if ((ret = sfs_bmap_get_sub_nolock(sfs, sin, &ent, index, create, &ino)) != 0) {
             return ret;
         }
         if (ent != din->indirect) {
@@ -454,6 +518,156 @@ sfs_dirent_read_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot, stru
         }                                                                           \
     } while (0)
 
+/*
+ * 目录的内存名字索引: 目录的每个槽位(即每个目录数据块)对应一个sfs_dirnode,
+ * 使用中的槽位按文件名挂在哈希表上, 空闲槽位(ino == 0)挂在free_list上.
+ * 索引在第一次查找时扫描整个目录建立, 之后的查找不再读盘, 空闲槽位也直接从free_list取.
+ * 修改目录项(link/unlink)的代码在写盘之后要用sfs_dirindex_update_nolock同步索引.
+ * 索引随目录inode一起在sfs_reclaim中释放.
+ */
+struct sfs_dirnode {
+    int slot;                                       /* 目录中的槽位 */
+    uint32_t ino;                                   /* 该槽位的文件的inode编号, 0表示空闲 */
+    list_entry_t link;                              /* 哈希链或free_list中的链接 */
+    char name[SFS_MAX_FNAME_LEN + 1];
+};
+
+struct sfs_dirindex {
+    int nslots;                                     /* # of slots indexed */
+    int capacity;                                   /* size of slots[] */
+    struct sfs_dirnode **slots;                     /* slot -> dirnode */
+    list_entry_t free_list;                         /* free slots */
+    list_entry_t hash[SFS_DIRINDEX_SIZE];           /* name -> dirnode */
+};
+
+#define le2dirnode(le)                              \
+    to_struct((le), struct sfs_dirnode, link)
+
+static list_entry_t *
+sfs_dirindex_hash(struct sfs_dirindex *idx, const char *name) {
+    uint32_t h = 0;
+    while (*name != '\0') {
+        h = h * 31 + (unsigned char)(*name ++);
+    }
+    return idx->hash + hash32(h, SFS_DIRINDEX_SHIFT);
+}
+
+/*
+ * sfs_dirindex_destroy - free the name index of a directory
+ */
+static void
+sfs_dirindex_destroy(struct sfs_dirindex *idx) {
+    int i;
+    for (i = 0; i < idx->nslots; i ++) {
+        kfree(idx->slots[i]);
+    }
+    if (idx->slots != NULL) {
+        kfree(idx->slots);
+    }
+    kfree(idx);
+}
+
+/*
+ * sfs_dirindex_update_nolock - 槽位slot的目录项变成了(ino, name), ino == 0表示槽位被释放.
+ *                              slot可以等于nslots, 即目录末尾新增的槽位.
+ */
+static int
+sfs_dirindex_update_nolock(struct sfs_dirindex *idx, int slot, uint32_t ino, const char *name) {
+    assert(slot >= 0 && slot <= idx->nslots);
+    struct sfs_dirnode *node;
+    if (slot == idx->nslots) {
+        if (idx->nslots == idx->capacity) {
+            int capacity = (idx->capacity == 0) ? 16 : idx->capacity * 2;
+            struct sfs_dirnode **slots;
+            if ((slots = kmalloc(capacity * sizeof(struct sfs_dirnode *))) == NULL) {
+                return -E_NO_MEM;
+            }
+            if (idx->slots != NULL) {
+                memcpy(slots, idx->slots, idx->nslots * sizeof(struct sfs_dirnode *));
+                kfree(idx->slots);
+            }
+            idx->slots = slots, idx->capacity = capacity;
+        }
+        if ((node = kmalloc(sizeof(struct sfs_dirnode))) == NULL) {
+            return -E_NO_MEM;
+        }
+        node->slot = slot;
+        list_init(&(node->link));
+        idx->slots[idx->nslots ++] = node;
+    }
+    else {
+        node = idx->slots[slot];
+        list_del(&(node->link));
+    }
+    if ((node->ino = ino) == 0) {
+        node->name[0] = '\0';
+        list_add_before(&(idx->free_list), &(node->link));
+    }
+    else {
+        strcpy(node->name, name);
+        list_add(sfs_dirindex_hash(idx, name), &(node->link));
+    }
+    return 0;
+}
+
+/*
+ * sfs_dirindex_build_nolock - 读出目录的所有目录项, 建立名字索引
+ */
+static int
+sfs_dirindex_build_nolock(struct sfs_fs *sfs, struct sfs_inode *sin) {
+    struct sfs_dirindex *idx;
+    struct sfs_disk_entry *entry;
+    if ((idx = kmalloc(sizeof(struct sfs_dirindex))) == NULL) {
+        return -E_NO_MEM;
+    }
+    if ((entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
+        kfree(idx);
+        return -E_NO_MEM;
+    }
+    idx->nslots = idx->capacity = 0, idx->slots = NULL;
+    list_init(&(idx->free_list));
+    int ret, i;
+    for (i = 0; i < SFS_DIRINDEX_SIZE; i ++) {
+        list_init(idx->hash + i);
+    }
+    for (i = 0; i < sin->din->blocks; i ++) {
+        if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0
+            || (ret = sfs_dirindex_update_nolock(idx, i, entry->ino, entry->name)) != 0) {
+            sfs_dirindex_destroy(idx);
+            goto out;
+        }
+    }
+    sin->dirindex = idx, ret = 0;
+out:
+    kfree(entry);
+    return ret;
+}
+
+/*
+ * sfs_dirindex_search_nolock - 在目录的名字索引中查找name, 参数同sfs_dirent_search_nolock
+ */
+static int
+sfs_dirindex_search_nolock(struct sfs_dirindex *idx, const char *name, uint32_t *ino_store, int *slot, int *empty_slot) {
+    if (empty_slot != NULL) {
+        list_entry_t *le = list_next(&(idx->free_list));
+        *empty_slot = (le != &(idx->free_list)) ? le2dirnode(le)->slot : idx->nslots;
+    }
+    list_entry_t *list = sfs_dirindex_hash(idx, name), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct sfs_dirnode *node = le2dirnode(le);
+        if (strcmp(name, node->name) == 0) {
+            if (slot != NULL) {
+                *slot = node->slot;
+            }
+            if (ino_store != NULL) {
+                *ino_store = node->ino;
+            }
+            return 0;
+        }
+    }
+    return -E_NOENT;
+}
+
 /*
  * sfs_dirent_search_nolock - 读取目录中的每个文件条目，将文件名与每个条目的name进行比较。
  *                            如果相等，则返回此文件的inode的槽位和磁盘块编号。
@@ -476,6 +690,12 @@ SFS 通过设置 entry->ino 为 0 将该 entry 所在的 block 标记为 free，
 static int
 sfs_dirent_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name, uint32_t *ino_store, int *slot, int *empty_slot) {
     assert(strlen(name) <= SFS_MAX_FNAME_LEN);
+    // 有名字索引就直接查索引, 建立索引失败(内存不够)时退回逐个槽位读盘比较
+    if (sin->dirindex != NULL || sfs_dirindex_build_nolock(sfs, sin) == 0) {
+        assert(sin->dirindex->nslots == sin->din->blocks);
+        return sfs_dirindex_search_nolock(sin->dirindex, name, ino_store, slot, empty_slot);
+    }
+
     struct sfs_disk_entry *entry;
     if ((entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
         return -E_NO_MEM;
@@ -512,6 +732,17 @@ out:
 static int
 sfs_dirent_findino_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t ino, struct sfs_disk_entry *entry) {
     int ret, i, nslots = sin->din->blocks;
+    if (sin->dirindex != NULL) {
+        struct sfs_dirindex *idx = sin->dirindex;
+        for (i = 0; i < nslots; i ++) {
+            if (idx->slots[i]->ino == ino) {
+                entry->ino = ino;
+                strcpy(entry->name, idx->slots[i]->name);
+                return 0;
+            }
+        }
+        return -E_NOENT;
+    }
     for (i = 0; i < nslots; i ++) {
         if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
             return ret;
@@ -578,7 +809,140 @@ sfs_openfile(struct inode *node, uint32_t open_flags) {
 // sfs_close - close file
 static int
 sfs_close(struct inode *node) {
-    return vop_fsync(node);
+    // dirty data is written back by the writeback daemon, or when the inode is reclaimed
+    return 0;
+}
+
+/*
+ * sfs_getpage_nolock - 得到缓存文件第index个块的页缓存页, 未命中时从磁盘读入
+ * @sfs:        sfs文件系统
+ * @sin:        内存中的sfs inode
+ * @index:      文件内块的逻辑索引, 最大为din->blocks (等于din->blocks时为文件增长一个块)
+ * @fill:       布尔值, 未命中时是否读入块的内容 (调用者将覆盖整个块时为0)
+ * @page_store: 缓存该块的页
+ */
+static int
+sfs_getpage_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, bool fill, struct Page **page_store) {
+    struct Page *page;
+    if ((page = pcache_lookup(&(sin->pcache), index)) != NULL) {
+        goto out;
+    }
+    if ((page = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+
+    int ret;
+    uint32_t ino;
+    bool create = (index == sin->din->blocks);
+    if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &ino)) != 0) {
+        goto failed_cleanup_page;
+    }
+    if (fill) {
+        if (create) {
+            memset(page2kva(page), 0, SFS_BLKSIZE);
+        }
+        else if ((ret = sfs_rblock_direct(sfs, page2kva(page), ino, 1)) != 0) {
+            goto failed_cleanup_page;
+        }
+    }
+    pcache_insert(&(sin->pcache), index, page);
+
+out:
+    *page_store = page;
+    return 0;
+
+failed_cleanup_page:
+    free_page(page);
+    return ret;
+}
+
+/*
+ * sfs_fill_pages_nolock - 把文件[index, index + nblks)中尚未缓存的块读入页缓存。
+ *                         磁盘上物理连续且都未缓存的一段块(一个extent)只发一次多块的dop_io,
+ *                         读入一段物理连续的页中
+ */
+static int
+sfs_fill_pages_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, uint32_t nblks) {
+    assert(index + nblks <= sin->din->blocks);
+    int ret;
+    uint32_t ino, next_ino, run, i;
+    struct Page *page;
+    while (nblks != 0) {
+        if (pcache_lookup(&(sin->pcache), index) != NULL) {
+            index ++, nblks --;
+            continue;
+        }
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &ino)) != 0) {
+            return ret;
+        }
+        // extend the run while the following blocks are uncached and physically next to it
+        for (run = 1; run < nblks && run < SFS_IO_MAX_RUN; run ++) {
+            if (pcache_lookup(&(sin->pcache), index + run) != NULL) {
+                break;
+            }
+            if ((ret = sfs_bmap_load_nolock(sfs, sin, index + run, &next_ino)) != 0) {
+                return ret;
+            }
+            if (next_ino != ino + run) {
+                break;
+            }
+        }
+        // fall back to shorter runs if memory is too fragmented
+        while ((page = alloc_pages(run)) == NULL) {
+            if (run == 1) {
+                return -E_NO_MEM;
+            }
+            run /= 2;
+        }
+        if ((ret = sfs_rblock_direct(sfs, page2kva(page), ino, run)) != 0) {
+            free_pages(page, run);
+            return ret;
+        }
+        for (i = 0; i < run; i ++) {
+            pcache_insert(&(sin->pcache), index + i, page + i);
+        }
+        index += run, nblks -= run;
+    }
+    return 0;
+}
+
+/*
+ * sfs_sync_pages_nolock - 将文件页缓存中的脏页写回磁盘。
+ *                         在内存和磁盘上都连续的一串脏页合并为一次多块的写
+ */
+static int
+sfs_sync_pages_nolock(struct sfs_fs *sfs, struct sfs_inode *sin) {
+    int ret;
+    uint32_t ino, next_ino, run, i;
+    list_entry_t *list = &(sin->pcache.page_list), *le = list;
+    while (sin->pcache.nr_dirty != 0 && (le = list_next(le)) != list) {
+        struct Page *page = le2pcpage(le), *next;
+        if (!PageDirty(page)) {
+            continue;
+        }
+        assert(page->index < sin->din->blocks);
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, page->index, &ino)) != 0) {
+            return ret;
+        }
+        for (run = 1; run < SFS_IO_MAX_RUN && page->index + run < sin->din->blocks; run ++) {
+            if ((next = pcache_lookup(&(sin->pcache), page->index + run)) != page + run || !PageDirty(next)) {
+                break;
+            }
+            if ((ret = sfs_bmap_load_nolock(sfs, sin, page->index + run, &next_ino)) != 0) {
+                return ret;
+            }
+            if (next_ino != ino + run) {
+                break;
+            }
+        }
+        if ((ret = sfs_wblock_direct(sfs, page2kva(page), ino, run)) != 0) {
+            return ret;
+        }
+        for (i = 0; i < run; i ++) {
+            pcache_clear_dirty(page + i);
+        }
+    }
+    return 0;
 }
 
 /*
@@ -591,9 +955,9 @@ sfs_close(struct inode *node) {
  * @write:    布尔值，0表示读取，1表示写入
  */
 /*
-先计算一些辅助变量，并处理一些特殊情况（比如越界），然后有sfs_buf_op = sfs_rbuf,sfs_block_op = sfs_rblock，设置读取的函数操作。
-接着进行实际操作，先处理起始的没有对齐到块的部分，再以块为单位循环处理中间的部分，最后处理末尾剩余的部分。
-每部分中都调用sfs_bmap_load_nolock函数得到blkno对应的inode编号，并调用sfs_rbuf或sfs_rblock函数读取数据（中间部分调用sfs_rblock，起始和末尾部分调用sfs_rbuf），调整相关变量。
+先计算一些辅助变量，并处理一些特殊情况（比如越界）。
+接着逐块处理[offset, endpos)：通过sfs_getpage_nolock得到缓存该块的页（未命中时才访问磁盘），
+然后在页与缓冲区之间拷贝数据；写操作只把页标记为脏，由sfs_fsync写回磁盘。
 完成后如果offset + alen > din->fileinfo.size（写文件时会出现这种情况，读文件时不会出现这种情况，alen为实际读写的长度），则调整文件大小为offset + alen并设置dirty变量。
 */
 static int
@@ -622,84 +986,44 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf, off_t offset
         }
     }
 
-    int (*sfs_buf_op)(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
-    int (*sfs_block_op)(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
-    if (write) {
-        sfs_buf_op = sfs_wbuf, sfs_block_op = sfs_wblock;
-    }
-    else {
-        sfs_buf_op = sfs_rbuf, sfs_block_op = sfs_rblock;
-    }
-
     int ret = 0;
     size_t size, alen = 0;
-    uint32_t ino;
+    struct Page *page;
     uint32_t blkno = offset / SFS_BLKSIZE;          // The NO. of Rd/Wr begin block
-    uint32_t nblks = endpos / SFS_BLKSIZE - blkno;  // The size of Rd/Wr blocks
-
-  //LAB8:EXERCISE1 YOUR CODE HINT: call sfs_bmap_load_nolock, sfs_rbuf, sfs_rblock,etc. read different kind of blocks in file
-	/*
-	 * (1) If offset isn't aligned with the first block, Rd/Wr some content from offset to the end of the first block
-	 *       NOTICE: useful function: sfs_bmap_load_nolock, sfs_buf_op
-	 *               Rd/Wr size = (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset)
-	 * (2) Rd/Wr aligned blocks 
-	 *       NOTICE: useful function: sfs_bmap_load_nolock, sfs_block_op
-     * (3) If end position isn't aligned with the last block, Rd/Wr some content from begin to the (endpos % SFS_BLKSIZE) of the last block
-	 *       NOTICE: useful function: sfs_bmap_load_nolock, sfs_buf_op	
-	*/
-    
-    //读取时，首先要对上一次读取的块是否读取完进行判断。
-    //如果offset 不能整除 SFS_BLKSIZE(4k)，则得到的余数是上一个被读取的块被读取了多少。拿SFS_BLKSIZE减去这个余数就是上一个块还剩多少需要被读取。
-    if ((blkoff = offset % SFS_BLKSIZE) != 0) {
-        size = (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset);
-        //首先得把上一个块的剩下这么多SFS_BLKSIZE - blkoff数据给读出来
-
-        //先找到上一个块的inode
-        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-            goto out;
-        }
-        // 然后再从上一个块中把剩下的读出来,这个函数会对应到sfs_rwblock_nolock
-        if ((ret = sfs_buf_op(sfs, buf, size, ino, blkoff)) != 0) {
-            goto out;
-        }
-
-        alen += size;
-        buf += size;
 
-        if (nblks == 0) {
+    uint32_t endblk = ROUNDUP_DIV(endpos, SFS_BLKSIZE);
+    if (!write) {
+        // bring all missing blocks in first, one request per contiguous extent
+        if ((ret = sfs_fill_pages_nolock(sfs, sin, blkno, endblk - blkno)) != 0) {
             goto out;
         }
-
-        blkno++;
-        nblks--;
+    }
+    else if (endblk > din->blocks + 1) {
+        // appending several blocks, try to place them contiguously on disk
+        sfs_bmap_reserve_nolock(sfs, sin, endblk - din->blocks, 0);
     }
 
-    if (nblks > 0) {
-        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-            goto out;
+    for (blkoff = offset % SFS_BLKSIZE; offset + alen < endpos; blkno ++, blkoff = 0) {
+        if ((size = SFS_BLKSIZE - blkoff) > endpos - (offset + alen)) {
+            size = endpos - (offset + alen);
         }
-        if ((ret = sfs_block_op(sfs, buf, ino, nblks)) != 0) {
+        // a block which is going to be overwritten as a whole needn't be read first
+        bool fill = (!write || size != SFS_BLKSIZE);
+        if ((ret = sfs_getpage_nolock(sfs, sin, blkno, fill, &page)) != 0) {
             goto out;
         }
-
-        alen += nblks * SFS_BLKSIZE;
-        buf += nblks * SFS_BLKSIZE;
-        blkno += nblks;
-        nblks -= nblks;
-    }
-
-    if ((size = endpos % SFS_BLKSIZE) != 0) {
-        if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
-            goto out;
+        if (write) {
+            memcpy(page2kva(page) + blkoff, buf, size);
+            pcache_set_dirty(page);
         }
-        if ((ret = sfs_buf_op(sfs, buf, size, ino, 0)) != 0) {
-            goto out;
+        else {
+            memcpy(buf, page2kva(page) + blkoff, size);
         }
-        alen += size;
+        alen += size, buf += size;
     }
-    
 
 out:
+    sfs_bmap_unreserve_nolock(sfs, sin);
     *alenp = alen;
     if (offset + alen > sin->din->size) {
         sin->din->size = offset + alen;
@@ -743,6 +1067,81 @@ sfs_write(struct inode *node, struct iobuf *iob) {
     return sfs_io(node, iob, 1);
 }
 
+/*
+ * sfs_readahead - 把文件[offset, offset + len)中尚未缓存的块预先读入页缓存
+ */
+static int
+sfs_readahead(struct inode *node, off_t offset, size_t len) {
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    struct sfs_inode *sin = vop_info(node, sfs_inode);
+    int ret = 0;
+    lock_sin(sin);
+    {
+        struct sfs_disk_inode *din = sin->din;
+        off_t endpos = offset + len;
+        if (endpos > din->size) {
+            endpos = din->size;
+        }
+        if (offset < endpos) {
+            uint32_t blkno = offset / SFS_BLKSIZE;
+            ret = sfs_fill_pages_nolock(sfs, sin, blkno, ROUNDUP_DIV(endpos, SFS_BLKSIZE) - blkno);
+        }
+    }
+    unlock_sin(sin);
+    return ret;
+}
+
+/*
+ * sfs_mappage - 得到缓存文件第index个块的页缓存页并为调用者增加其引用计数, 用于把文件映射到用户地址空间。
+ *               文件末尾所在的页中, 文件末尾之后的部分被清零
+ * @cached:      为1时只查找页缓存, 未命中时返回-E_NOENT而不读盘
+ */
+static int
+sfs_mappage(struct inode *node, uint32_t index, bool cached, struct Page **page_store) {
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    struct sfs_inode *sin = vop_info(node, sfs_inode);
+    int ret = -E_INVAL;
+    lock_sin(sin);
+    {
+        struct sfs_disk_inode *din = sin->din;
+        struct Page *page;
+        off_t pos = (off_t)index * SFS_BLKSIZE;
+        if (pos >= din->size) {
+            goto out;
+        }
+        if (cached) {
+            if ((page = pcache_lookup(&(sin->pcache), index)) == NULL) {
+                ret = -E_NOENT;
+                goto out;
+            }
+            ret = 0;
+        }
+        else if ((ret = sfs_getpage_nolock(sfs, sin, index, 1, &page)) != 0) {
+            goto out;
+        }
+        if (din->size - pos < SFS_BLKSIZE) {
+            memset(page2kva(page) + (din->size - pos), 0, SFS_BLKSIZE - (din->size - pos));
+        }
+        page_ref_inc(page);
+        *page_store = page;
+    }
+out:
+    unlock_sin(sin);
+    return ret;
+}
+
+// sfs_getpage - 得到文件第index块的页缓存页, 未命中时从磁盘读入
+static int
+sfs_getpage(struct inode *node, uint32_t index, struct Page **page_store) {
+    return sfs_mappage(node, index, 0, page_store);
+}
+
+// sfs_findpage - 得到文件第index块已缓存的页, 未命中时返回-E_NOENT
+static int
+sfs_findpage(struct inode *node, uint32_t index, struct Page **page_store) {
+    return sfs_mappage(node, index, 1, page_store);
+}
+
 /*
  * sfs_fstat - Return nlinks/block/size, etc. info about a file. The pointer is a pointer to struct stat;
  */
@@ -761,16 +1160,19 @@ sfs_fstat(struct inode *node, struct stat *stat) {
 }
 
 /*
- * sfs_fsync - Force any dirty inode info associated with this file to stable storage.
+ * sfs_fsync - Force any dirty data pages and inode info associated with this file to stable storage.
  */
 static int
 sfs_fsync(struct inode *node) {
     struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
     struct sfs_inode *sin = vop_info(node, sfs_inode);
     int ret = 0;
-    if (sin->dirty) {
+    if (sin->dirty || sin->pcache.nr_dirty != 0) {
         lock_sin(sin);
         {
+            if ((ret = sfs_sync_pages_nolock(sfs, sin)) != 0) {
+                goto out_unlock;
+            }
             if (sin->dirty) {
                 sin->dirty = 0;
                 if ((ret = sfs_wbuf(sfs, sin->din, sizeof(struct sfs_disk_inode), sin->ino, 0)) != 0) {
@@ -778,6 +1180,7 @@ sfs_fsync(struct inode *node) {
                 }
             }
         }
+out_unlock:
         unlock_sin(sin);
     }
     return ret;
@@ -924,7 +1327,7 @@ sfs_reclaim(struct inode *node) {
             goto failed_unlock;
         }
     }
-    if (sin->dirty) {
+    if (sin->dirty || sin->pcache.nr_dirty != 0) {
         if ((ret = vop_fsync(node)) != 0) {
             goto failed_unlock;
         }
@@ -932,13 +1335,18 @@ sfs_reclaim(struct inode *node) {
     sfs_remove_links(sin);
     unlock_sfs_fs(sfs);
 
+    pcache_truncate(&(sin->pcache), 0);
+    if (sin->dirindex != NULL) {
+        sfs_dirindex_destroy(sin->dirindex);
+    }
+
     if (sin->din->nlinks == 0) {
         sfs_block_free(sfs, sin->ino);
         if ((ent = sin->din->indirect) != 0) {
             sfs_block_free(sfs, ent);
         }
     }
-    kfree(sin->din);
+    kmem_cache_free(sfs_din_cachep, sin->din);
     vop_kill(node);
     return 0;
 
@@ -1007,15 +1415,19 @@ sfs_truncfile(struct inode *node, off_t len) {
     nblks = din->blocks;
     if (nblks < tblks) {
 		// try to enlarge the file size by add new disk block at the end of file
+        sfs_bmap_reserve_nolock(sfs, sin, tblks - nblks, 1);
         while (nblks != tblks) {
             if ((ret = sfs_bmap_load_nolock(sfs, sin, nblks, NULL)) != 0) {
+                sfs_bmap_unreserve_nolock(sfs, sin);
                 goto out_unlock;
             }
             nblks ++;
         }
+        assert(sin->resv_blocks == 0);
     }
     else if (tblks < nblks) {
-		// try to reduce the file size 
+		// try to reduce the file size, the cached pages of the dropped blocks go first
+        pcache_truncate(&(sin->pcache), tblks);
         while (tblks != nblks) {
             if ((ret = sfs_bmap_truncate_nolock(sfs, sin)) != 0) {
                 goto out_unlock;
@@ -1091,5 +1503,8 @@ static const struct inode_ops sfs_node_fileops = {
     .vop_gettype                    = sfs_gettype,
     .vop_tryseek                    = sfs_tryseek,
     .vop_truncate                   = sfs_truncfile,
+    .vop_readahead                  = sfs_readahead,
+    .vop_getpage                    = sfs_getpage,
+    .vop_findpage                   = sfs_findpage,
 };
 
@@ -4,11 +4,12 @@
 #include <sfs.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <bcache.h>
 #include <assert.h>
 
 //Basic block-level I/O routines
 
-/* sfs_rwblock_nolock - Basic block-level I/O routine for Rd/Wr one disk block,
+/* sfs_rwblock_nolock - Basic block-level I/O routine for Rd/Wr one disk block through the buffer cache,
  *                      without lock protect for mutex process on Rd/Wr disk block
  * @sfs:   sfs_fs which will be process
  * @buf:   the buffer uesed for Rd/Wr
@@ -19,8 +20,22 @@
 static int
 sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write, bool check) {
     assert((blkno != 0 || !check) && blkno < sfs->super.blocks);
-    struct iobuf __iob, *iob = iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
-    return dop_io(sfs->dev, iob, write);
+    int ret;
+    struct buf *bh;
+    if (write) {
+        if ((ret = bcache_get(sfs->dev, blkno, &bh)) == 0) {
+            memcpy(bh->b_data, buf, SFS_BLKSIZE);
+            bcache_dirty(bh);
+            bcache_release(bh);
+        }
+    }
+    else {
+        if ((ret = bcache_read(sfs->dev, blkno, &bh)) == 0) {
+            memcpy(buf, bh->b_data, SFS_BLKSIZE);
+            bcache_release(bh);
+        }
+    }
+    return ret;
 }
 
 /* sfs_rwblock - Basic block-level I/O routine for Rd/Wr N disk blocks ,
@@ -72,7 +87,32 @@ sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
     return sfs_rwblock(sfs, buf, blkno, nblks, 1);
 }
 
-/* sfs_rbuf - 用于读取一个磁盘块的基本块级I/O例程（非块和非对齐io），使用sfs->sfs_buffer，并使用锁来保护在读/写磁盘块时的互斥处理。
+/* sfs_rblock_direct - Rd N file data blocks from disk, bypassing the buffer cache
+ *                     (file data is cached in the page cache of its inode).
+ * @sfs:   sfs_fs which will be process
+ * @buf:   the buffer uesed for Rd
+ * @blkno: the NO. of disk block
+ * @nblks: Rd number of disk block
+ */
+int
+sfs_rblock_direct(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
+    assert(blkno != 0 && blkno + nblks <= sfs->super.blocks);
+    return bcache_io_direct(sfs->dev, buf, blkno, nblks, 0);
+}
+
+/* sfs_wblock_direct - Wr N file data blocks to disk, bypassing the buffer cache
+ * @sfs:   sfs_fs which will be process
+ * @buf:   the buffer uesed for Wr
+ * @blkno: the NO. of disk block
+ * @nblks: Wr number of disk block
+ */
+int
+sfs_wblock_direct(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
+    assert(blkno != 0 && blkno + nblks <= sfs->super.blocks);
+    return bcache_io_direct(sfs->dev, buf, blkno, nblks, 1);
+}
+
+/* sfs_rbuf - 用于读取一个磁盘块的基本块级I/O例程（非块和非对齐io），直接从缓冲区缓存中拷贝，并使用锁来保护在读/写磁盘块时的互斥处理。
  * @sfs:    将要处理的sfs_fs
  * @buf:    用于读取的缓冲区
  * @len:    需要读取的长度
@@ -82,18 +122,22 @@ sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
 int
 sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
+    assert(blkno != 0 && blkno < sfs->super.blocks);
     int ret;
+    struct buf *bh;
     lock_sfs_io(sfs);
     {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(buf, sfs->sfs_buffer + offset, len);
+        if ((ret = bcache_read(sfs->dev, blkno, &bh)) == 0) {
+            memcpy(buf, bh->b_data + offset, len);
+            bcache_release(bh);
         }
     }
     unlock_sfs_io(sfs);
     return ret;
 }
 
-/* sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block(using sfs->sfs_buffer)
+/* sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block
+ *            (modify the cached block in place and mark it dirty)
  *            with lock protect for mutex process on Rd/Wr disk block
  * @sfs:    sfs_fs which will be process
  * @buf:    the buffer uesed for Wr
@@ -104,12 +148,15 @@ sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset
 int
 sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
+    assert(blkno != 0 && blkno < sfs->super.blocks);
     int ret;
+    struct buf *bh;
     lock_sfs_io(sfs);
     {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(sfs->sfs_buffer + offset, buf, len);
-            ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1);
+        if ((ret = bcache_read(sfs->dev, blkno, &bh)) == 0) {
+            memcpy(bh->b_data + offset, buf, len);
+            bcache_dirty(bh);
+            bcache_release(bh);
         }
     }
     unlock_sfs_io(sfs);
@@ -117,23 +164,27 @@ sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset
 }
 
 /*
- * sfs_sync_super - write sfs->super (in memory) into disk (SFS_BLKN_SUPER, 1) with lock protect.
+ * sfs_sync_super - write sfs->super (in memory) into the cached super block (SFS_BLKN_SUPER, 1) with lock protect.
  */
 int
 sfs_sync_super(struct sfs_fs *sfs) {
     int ret;
+    struct buf *bh;
     lock_sfs_io(sfs);
     {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-        memcpy(sfs->sfs_buffer, &(sfs->super), sizeof(sfs->super));
-        ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, SFS_BLKN_SUPER, 1, 0);
+        if ((ret = bcache_get(sfs->dev, SFS_BLKN_SUPER, &bh)) == 0) {
+            memset(bh->b_data, 0, SFS_BLKSIZE);
+            memcpy(bh->b_data, &(sfs->super), sizeof(sfs->super));
+            bcache_dirty(bh);
+            bcache_release(bh);
+        }
     }
     unlock_sfs_io(sfs);
     return ret;
 }
 
 /*
- * sfs_sync_freemap - write sfs bitmap into disk (SFS_BLKN_FREEMAP, nblks)  without lock protect.
+ * sfs_sync_freemap - write sfs bitmap into the cached freemap blocks (SFS_BLKN_FREEMAP, nblks)  without lock protect.
  */
 int
 sfs_sync_freemap(struct sfs_fs *sfs) {
@@ -142,21 +193,25 @@ sfs_sync_freemap(struct sfs_fs *sfs) {
 }
 
 /*
- * sfs_clear_block - 使用锁保护，将零信息写入磁盘（blkno、nblks）。
+ * sfs_clear_block - 使用锁保护，将零信息写入缓冲区缓存中的磁盘块（blkno、nblks）。
  * @sfs: 将要处理的sfs_fs
  * @blkno: 磁盘块的编号
  * @nblks: 磁盘块的读/写数量
  */
 int
 sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks) {
-    int ret;
+    int ret = 0;
+    struct buf *bh;
     lock_sfs_io(sfs);
     {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
         while (nblks != 0) {
-            if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1)) != 0) {
+            assert(blkno != 0 && blkno < sfs->super.blocks);
+            if ((ret = bcache_get(sfs->dev, blkno, &bh)) != 0) {
                 break;
             }
+            memset(bh->b_data, 0, SFS_BLKSIZE);
+            bcache_dirty(bh);
+            bcache_release(bh);
             blkno ++, nblks --;
         }
     }
@@ -164,3 +219,10 @@ sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks) {
     return ret;
 }
 
+/*
+ * sfs_sync_buffers - write all dirty cached blocks of this sfs back to disk.
+ */
+int
+sfs_sync_buffers(struct sfs_fs *sfs) {
+    return bcache_sync(sfs->dev);
+}
@@ -1,6 +1,7 @@
 #include <defs.h>
 #include <string.h>
 #include <vmm.h>
+#include <pmm.h>
 #include <proc.h>
 #include <kmalloc.h>
 #include <vfs.h>
@@ -13,7 +14,7 @@
 #include <error.h>
 #include <assert.h>
 
-#define IOBUF_SIZE                          4096
+#define SYSFILE_IO_NPAGES                   64      // max # of user pages pinned for one file Rd/Wr
 
 /* copy_path - copy path name */
 static int
@@ -56,107 +57,123 @@ sysfile_close(int fd) {
     return file_close(fd);
 }
 
-/* sysfile_read - read file */
 /*
-检查错误，即检查读取长度是否为0和文件是否可读。
-分配buffer空间，即调用kmalloc函数分配4096字节的buffer空间。
-读文件过程
-*/
-int
-sysfile_read(int fd, void *base, size_t len) {
-    struct mm_struct *mm = current->mm;
-    if (len == 0) {
-        return 0;
-    }
-    if (!file_testfd(fd, 1, 0)) {
-        return -E_INVAL;
-    }
-    void *buffer;
-    if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-        return -E_NO_MEM;
-    }
-
+ * sysfile_io_pages - Rd/Wr @len bytes from offset @off of the pinned user @pages, through the kernel
+ *                    mapping of the pages, one file_read/file_write per run of physically contiguous
+ *                    pages. the # of bytes moved is stored in @copied_store.
+ */
+static int
+sysfile_io_pages(int fd, struct Page **pages, size_t npages, size_t off, size_t len, bool write, size_t *copied_store) {
     int ret = 0;
-    size_t copied = 0, alen;
-    while (len != 0) {//循环读取文件
-        if ((alen = IOBUF_SIZE) > len) {//每次最多读取4096字节
-            alen = len;//剩余len小于buffersize就只读取剩余的len
+    size_t copied = 0, i = 0, j, alen, n;
+    while (ret == 0 && copied < len) {
+        j = i + 1;
+        while (j < npages && pages[j] == pages[j - 1] + 1) {
+            j ++;
         }
-        ret = file_read(fd, buffer, alen, &alen);//将文件内容读取到buffer中
-        if (alen != 0) {
-            lock_mm(mm);
-            {
-                if (copy_to_user(mm, base, buffer, alen)) {//将buffer中的内容复制到用户内存空间
-                    assert(len >= alen);
-                    base += alen, len -= alen, copied += alen;
-                }
-                else if (ret == 0) {
-                    ret = -E_INVAL;
-                }
-            }
-            unlock_mm(mm);
+        if ((alen = (j - i) * PGSIZE - off) > len - copied) {
+            alen = len - copied;
         }
-        if (ret != 0 || alen == 0) {
-            goto out;
+        void *kva = page2kva(pages[i]) + off;
+        ret = (write) ? file_write(fd, kva, alen, &n) : file_read(fd, kva, alen, &n);
+        copied += n;
+        if (n < alen) {
+            break;
         }
+        i = j, off = 0;
     }
-
-out:
-    kfree(buffer);
-    if (copied != 0) {
-        return copied;
-    }
+    *copied_store = copied;
     return ret;
 }
 
-/* sysfile_write - write file */
-int
-sysfile_write(int fd, void *base, size_t len) {
+/*
+ * sysfile_io - Rd/Wr file straight from/to the buffer of the caller, without a bounce buffer.
+ *              up to SYSFILE_IO_NPAGES user pages are faulted in and pinned under lock_mm at a
+ *              time, then lock_mm is dropped while the file data is moved, as file_read may block
+ *              for long (stdin, pipes, the disk) and the mm must stay usable by other threads.
+ * @write: true for sysfile_write (the user buffer is read), false for sysfile_read
+ */
+static int
+sysfile_io(int fd, void *base, size_t len, bool write) {
     struct mm_struct *mm = current->mm;
-    if (len == 0) {
-        return 0;
+    int ret = 0;
+    size_t copied = 0, alen, n;
+    if (mm == NULL) {
+        // kernel buffer (e.g. load_icode reading an ELF), nothing to pin
+        if (!user_mem_check(NULL, (uintptr_t)base, len, !write)) {
+            return -E_INVAL;
+        }
+        ret = (write) ? file_write(fd, base, len, &copied) : file_read(fd, base, len, &copied);
+        goto out;
     }
-    if (!file_testfd(fd, 0, 1)) {
+
+    lock_mm(mm);
+    bool valid = user_mem_check(mm, (uintptr_t)base, len, !write);
+    unlock_mm(mm);
+    if (!valid) {
         return -E_INVAL;
     }
-    void *buffer;
-    if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-        return -E_NO_MEM;
-    }
 
-    int ret = 0;
-    size_t copied = 0, alen;
+    struct Page *pages[SYSFILE_IO_NPAGES];
     while (len != 0) {
-        if ((alen = IOBUF_SIZE) > len) {
+        uintptr_t start = (uintptr_t)base;
+        if ((alen = SYSFILE_IO_NPAGES * PGSIZE - start % PGSIZE) > len) {
             alen = len;
         }
+        size_t npages = (ROUNDUP(start + alen, PGSIZE) - ROUNDDOWN(start, PGSIZE)) / PGSIZE;
+        // the mapping may have changed while the last pages were moved, check it again
         lock_mm(mm);
         {
-            if (!copy_from_user(mm, buffer, base, alen, 0)) {
-                ret = -E_INVAL;
-            }
+            ret = (user_mem_check(mm, start, alen, !write)) ? user_mem_pin(mm, start, alen, !write, pages) : -E_INVAL;
         }
         unlock_mm(mm);
-        if (ret == 0) {
-            ret = file_write(fd, buffer, alen, &alen);
-            if (alen != 0) {
-                assert(len >= alen);
-                base += alen, len -= alen, copied += alen;
-            }
+        if (ret != 0) {
+            goto out;
         }
-        if (ret != 0 || alen == 0) {
+        ret = sysfile_io_pages(fd, pages, npages, start % PGSIZE, alen, write, &n);
+        user_mem_unpin(pages, npages);
+        assert(n <= alen);
+        base += n, len -= n, copied += n;
+        if (ret != 0 || n < alen) {
             goto out;
         }
     }
 
 out:
-    kfree(buffer);
     if (copied != 0) {
         return copied;
     }
     return ret;
 }
 
+/* sysfile_read - read file */
+/*
+检查错误，即检查读取长度是否为0和文件是否可读。
+文件数据直接读进用户的buffer（见sysfile_io），不再经过内核中4096字节的中转buffer。
+*/
+int
+sysfile_read(int fd, void *base, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (!file_testfd(fd, 1, 0)) {
+        return -E_INVAL;
+    }
+    return sysfile_io(fd, base, len, 0);
+}
+
+/* sysfile_write - write file */
+int
+sysfile_write(int fd, void *base, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (!file_testfd(fd, 0, 1)) {
+        return -E_INVAL;
+    }
+    return sysfile_io(fd, base, len, 1);
+}
+
 /* sysfile_seek - seek file */
 int
 sysfile_seek(int fd, off_t pos, int whence) {
@@ -9,6 +9,7 @@
 
 struct stat;
 struct iobuf;
+struct Page;
 /*
  * inode结构是文件的抽象表示。
  * 它是一个接口，允许内核的与文件系统无关的代码有用地与多个文件系统代码集进行交互。
@@ -51,6 +52,7 @@ struct inode {
 #define info2node(info, type)                                       \
     to_struct((info), struct inode, in_info.__##type##_info)
 
+void inode_cache_init(void);
 struct inode *__alloc_inode(int type);
 
 #define alloc_inode(type)                                           __alloc_inode(__in_type(type))
@@ -108,6 +110,12 @@ void inode_kill(struct inode *node);
  *
  *    vop_truncate    - 强制将文件的大小设置为传递的长度，丢弃任何多余的块。
  *
+ *    vop_readahead   - 提示文件系统[offset, offset + len)将很快被顺序读取，可以预先读入缓存。可选操作，可以为NULL。
+ *
+ *    vop_getpage     - 返回页缓存中缓存文件第index页的页（必要时读入），并为调用者增加页的引用计数；超出文件末尾时失败。用于把文件映射到用户地址空间。可选操作，可以为NULL。
+ *
+ *    vop_findpage    - 同vop_getpage，但只返回已在页缓存中的页，从不读盘；未缓存时返回-E_NOENT。用于缺页时顺便映射相邻的页。可选操作，可以为NULL。
+ *
  *    vop_namefile    - 计算相对于文件系统根的文件路径并复制到指定的io缓冲区。无需处理非目录对象。
  *
  *****************************************
@@ -192,6 +200,23 @@ void inode_kill(struct inode *node);
  *    vop_truncate    - Forcibly set size of file to the length passed
  *                      in, discarding any excess blocks.
  *
+ *    vop_readahead   - Hint that [offset, offset + len) of the file is
+ *                      about to be read sequentially, so it may be
+ *                      brought into the cache ahead of time. Optional,
+ *                      may be NULL.
+ *
+ *    vop_getpage     - Hand back the page cache page holding page INDEX
+ *                      of the file, reading it in if needed, with a
+ *                      reference taken for the caller. Fails past EOF.
+ *                      Used to map the file into user memory. Optional,
+ *                      may be NULL.
+ *
+ *    vop_findpage    - Like vop_getpage, but only hands back a page
+ *                      already in the page cache and never reads the
+ *                      disk, -E_NOENT if it is not cached. Used to map
+ *                      the pages around a faulting one. Optional, may
+ *                      be NULL.
+ *
  *    vop_namefile    - Compute pathname relative to filesystem root
  *                      of the file and copy to the specified io buffer. 
  *                      Need not work on objects that are not
@@ -230,6 +255,9 @@ struct inode_ops {
     int (*vop_create)(struct inode *node, const char *name, bool excl, struct inode **node_store);
     int (*vop_lookup)(struct inode *node, char *path, struct inode **node_store);
     int (*vop_ioctl)(struct inode *node, int op, void *data);
+    int (*vop_readahead)(struct inode *node, off_t offset, size_t len);
+    int (*vop_getpage)(struct inode *node, uint32_t index, struct Page **page_store);
+    int (*vop_findpage)(struct inode *node, uint32_t index, struct Page **page_store);
 };
 
 /*
@@ -260,6 +288,9 @@ void inode_check(struct inode *node, const char *opstr);
 #define vop_truncate(node, len)                                     (__vop_op(node, truncate)(node, len))
 #define vop_create(node, name, excl, node_store)                    (__vop_op(node, create)(node, name, excl, node_store))
 #define vop_lookup(node, path, node_store)                          (__vop_op(node, lookup)(node, path, node_store))
+#define vop_readahead(node, offset, len)                            (__vop_op(node, readahead)(node, offset, len))
+#define vop_getpage(node, index, page_store)                        (__vop_op(node, getpage)(node, index, page_store))
+#define vop_findpage(node, index, page_store)                       (__vop_op(node, findpage)(node, index, page_store))
 
 
 #define vop_fs(node)                                                ((node)->in_fs)
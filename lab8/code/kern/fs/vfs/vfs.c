@@ -27,6 +27,8 @@ void
 vfs_init(void) {
     sem_init(&bootfs_sem, 1);
     vfs_devlist_init();
+    inode_cache_init();
+    vfs_dcache_init();
 }
 
 // lock_bootfs - lock  for bootfs
@@ -18,6 +18,8 @@ struct iobuf;   // kernel or userspace I/O buffer (iobuf.h)
  * Operations:
  *
  *      fs_sync       - Flush all dirty buffers to disk.
+ *      fs_writeback  - Write back dirty inodes and file data in the background,
+ *                      dirty metadata blocks are left to the buffer cache.
  *      fs_get_root   - Return root inode of filesystem.
  *      fs_unmount    - Attempt unmount of filesystem.
  *      fs_cleanup    - Cleanup of filesystem.???
@@ -40,6 +42,7 @@ struct fs {
         fs_type_sfs_info,
     } fs_type;                                     // filesystem type 
     int (*fs_sync)(struct fs *fs);                 // Flush all dirty buffers to disk 
+    int (*fs_writeback)(struct fs *fs);            // Background writeback of dirty inodes and file data
     struct inode *(*fs_get_root)(struct fs *fs);   // Return root inode of filesystem.
     int (*fs_unmount)(struct fs *fs);              // Attempt unmount of filesystem.
     void (*fs_cleanup)(struct fs *fs);             // Cleanup of filesystem.???
@@ -66,6 +69,7 @@ struct fs *__alloc_fs(int type);
 
 // Macros to shorten the calling sequences.
 #define fsop_sync(fs)                       ((fs)->fs_sync(fs))
+#define fsop_writeback(fs)                  ((fs)->fs_writeback(fs))
 #define fsop_get_root(fs)                   ((fs)->fs_get_root(fs))
 #define fsop_unmount(fs)                    ((fs)->fs_unmount(fs))
 #define fsop_cleanup(fs)                    ((fs)->fs_cleanup(fs))
@@ -78,6 +82,7 @@ struct fs *__alloc_fs(int type);
  */
 void vfs_init(void);
 void vfs_cleanup(void);
+int vfs_writeback(void);
 void vfs_devlist_init(void);
 
 /*
@@ -138,6 +143,23 @@ int vfs_getcwd(struct iobuf *iob);
 int vfs_lookup(char *path, struct inode **node_store);
 int vfs_lookup_parent(char *path, struct inode **node_store, char **endp);
 
+/*
+ * Name cache (vfscache.c), used by vfs_lookup.
+ *
+ *    vfs_dcache_lookup     - look a name up in a directory, true on a hit;
+ *                            the inode found (NULL: the name does not exist)
+ *                            comes back with a reference.
+ *    vfs_dcache_add        - remember the result of a VOP_LOOKUP.
+ *    vfs_dcache_invalidate - forget a name, must be called when it is
+ *                            created, unlinked or renamed.
+ *    vfs_dcache_purge      - forget everything, before unmount/cleanup.
+ */
+void vfs_dcache_init(void);
+bool vfs_dcache_lookup(struct inode *dir, const char *name, struct inode **node_store);
+void vfs_dcache_add(struct inode *dir, const char *name, struct inode *node);
+void vfs_dcache_invalidate(struct inode *dir, const char *name);
+void vfs_dcache_purge(void);
+
 /*
  * Misc
  *
@@ -0,0 +1,207 @@
+#include <defs.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vfs.h>
+#include <inode.h>
+#include <sem.h>
+#include <list.h>
+#include <kmalloc.h>
+#include <assert.h>
+
+/*
+ * name cache (dcache): remembers the result of looking up a name in a
+ * directory, keyed by (directory inode, name).
+ * A positive entry holds a reference on both inodes, so a cached inode is
+ * never reclaimed behind our back; a negative entry (node == NULL) records
+ * that the name does not exist and must be dropped when it is created.
+ * At most DCACHE_NENTRY entries are kept, the least recently used goes first.
+ */
+
+#define DCACHE_NENTRY                       64
+#define DCACHE_HASH_SHIFT                   6
+#define DCACHE_HASH_SIZE                    (1 << DCACHE_HASH_SHIFT)
+
+struct dentry {
+    struct inode *dir;                      // the directory the name was looked up in
+    struct inode *node;                     // the inode found, NULL for a negative entry
+    char name[FS_MAX_FNAME_LEN + 1];
+    list_entry_t hash_link;                 // entry in the hash chain
+    list_entry_t lru_link;                  // entry in the lru list, most recent first
+};
+
+#define le2dentry(le, member)               \
+    to_struct((le), struct dentry, member)
+
+static list_entry_t dcache_hash[DCACHE_HASH_SIZE];
+static list_entry_t dcache_lru;
+static size_t dcache_nentry;
+static semaphore_t dcache_sem;
+
+static void
+lock_dcache(void) {
+    down(&dcache_sem);
+}
+
+static void
+unlock_dcache(void) {
+    up(&dcache_sem);
+}
+
+static list_entry_t *
+dcache_hashfn(struct inode *dir, const char *name) {
+    uint32_t h = (uint32_t)((uintptr_t)dir >> 4);
+    while (*name != '\0') {
+        h = h * 31 + (unsigned char)(*name ++);
+    }
+    return dcache_hash + hash32(h, DCACHE_HASH_SHIFT);
+}
+
+void
+vfs_dcache_init(void) {
+    int i;
+    for (i = 0; i < DCACHE_HASH_SIZE; i ++) {
+        list_init(dcache_hash + i);
+    }
+    list_init(&dcache_lru);
+    dcache_nentry = 0;
+    sem_init(&dcache_sem, 1);
+}
+
+static struct dentry *
+dcache_find_nolock(struct inode *dir, const char *name) {
+    list_entry_t *list = dcache_hashfn(dir, name), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct dentry *dentry = le2dentry(le, hash_link);
+        if (dentry->dir == dir && strcmp(dentry->name, name) == 0) {
+            return dentry;
+        }
+    }
+    return NULL;
+}
+
+static void
+dcache_unlink_nolock(struct dentry *dentry) {
+    list_del(&(dentry->hash_link));
+    list_del(&(dentry->lru_link));
+    dcache_nentry --;
+}
+
+/*
+ * dcache_free - drop the references held by a dentry taken out of the cache.
+ *               NOTICE: called without the dcache lock, the last reference
+ *               going away reclaims the inode, which may sleep.
+ */
+static void
+dcache_free(struct dentry *dentry) {
+    if (dentry->node != NULL) {
+        vop_ref_dec(dentry->node);
+    }
+    vop_ref_dec(dentry->dir);
+    kfree(dentry);
+}
+
+/*
+ * vfs_dcache_lookup - look @name up in @dir in the name cache.
+ *                     return true on a hit: *node_store is the inode with a reference
+ *                     taken for the caller, or NULL if the name is known not to exist.
+ */
+bool
+vfs_dcache_lookup(struct inode *dir, const char *name, struct inode **node_store) {
+    bool found = 0;
+    lock_dcache();
+    {
+        struct dentry *dentry;
+        if ((dentry = dcache_find_nolock(dir, name)) != NULL) {
+            if ((*node_store = dentry->node) != NULL) {
+                vop_ref_inc(dentry->node);
+            }
+            list_del(&(dentry->lru_link));
+            list_add(&dcache_lru, &(dentry->lru_link));
+            found = 1;
+        }
+    }
+    unlock_dcache();
+    return found;
+}
+
+/*
+ * vfs_dcache_add - remember that @name in @dir is @node (NULL: does not exist).
+ */
+void
+vfs_dcache_add(struct inode *dir, const char *name, struct inode *node) {
+    struct dentry *dentry, *victim = NULL;
+    if (strlen(name) > FS_MAX_FNAME_LEN || (dentry = kmalloc(sizeof(struct dentry))) == NULL) {
+        return ;
+    }
+    dentry->dir = dir, dentry->node = node;
+    strcpy(dentry->name, name);
+    lock_dcache();
+    {
+        if (dcache_find_nolock(dir, name) != NULL) {
+            // somebody else added it while we were looking the name up
+            unlock_dcache();
+            kfree(dentry);
+            return ;
+        }
+        vop_ref_inc(dir);
+        if (node != NULL) {
+            vop_ref_inc(node);
+        }
+        if (dcache_nentry == DCACHE_NENTRY) {
+            victim = le2dentry(list_prev(&dcache_lru), lru_link);
+            dcache_unlink_nolock(victim);
+        }
+        list_add(dcache_hashfn(dir, name), &(dentry->hash_link));
+        list_add(&dcache_lru, &(dentry->lru_link));
+        dcache_nentry ++;
+    }
+    unlock_dcache();
+    if (victim != NULL) {
+        dcache_free(victim);
+    }
+}
+
+/*
+ * vfs_dcache_invalidate - forget @name in @dir, called whenever the name is
+ *                         created, removed or renamed.
+ */
+void
+vfs_dcache_invalidate(struct inode *dir, const char *name) {
+    struct dentry *dentry;
+    lock_dcache();
+    {
+        if ((dentry = dcache_find_nolock(dir, name)) != NULL) {
+            dcache_unlink_nolock(dentry);
+        }
+    }
+    unlock_dcache();
+    if (dentry != NULL) {
+        dcache_free(dentry);
+    }
+}
+
+/*
+ * vfs_dcache_purge - drop all entries and the inode references they hold,
+ *                    called before a file system is unmounted or cleaned up.
+ */
+void
+vfs_dcache_purge(void) {
+    list_entry_t list;
+    list_init(&list);
+    lock_dcache();
+    {
+        list_entry_t *le;
+        while ((le = list_next(&dcache_lru)) != &dcache_lru) {
+            struct dentry *dentry = le2dentry(le, lru_link);
+            dcache_unlink_nolock(dentry);
+            list_add(&list, &(dentry->lru_link));
+        }
+        assert(dcache_nentry == 0);
+    }
+    unlock_dcache();
+    while (!list_empty(&list)) {
+        struct dentry *dentry = le2dentry(list_next(&list), lru_link);
+        list_del(&(dentry->lru_link));
+        dcache_free(dentry);
+    }
+}
@@ -46,6 +46,7 @@ vfs_devlist_init(void) {
 // vfs_cleanup - finally clean (or sync) fs
 void
 vfs_cleanup(void) {
+    vfs_dcache_purge();
     if (!list_empty(&vdev_list)) {
         lock_vdev_list();
         {
@@ -61,6 +62,29 @@ vfs_cleanup(void) {
     }
 }
 
+// vfs_writeback - background writeback of all mounted fs, called by the writeback daemon
+int
+vfs_writeback(void) {
+    int ret = 0;
+    if (!list_empty(&vdev_list)) {
+        lock_vdev_list();
+        {
+            list_entry_t *list = &vdev_list, *le = list;
+            while ((le = list_next(le)) != list) {
+                vfs_dev_t *vdev = le2vdev(le, vdev_link);
+                if (vdev->fs != NULL) {
+                    int err;
+                    if ((err = fsop_writeback(vdev->fs)) != 0 && ret == 0) {
+                        ret = err;
+                    }
+                }
+            }
+        }
+        unlock_vdev_list();
+    }
+    return ret;
+}
+
 /*
  * vfs_get_root - Given a device name (stdin, stdout, etc.), hand
  *                back an appropriate inode.
@@ -264,6 +288,7 @@ vfs_unmount(const char *devname) {
     }
     assert(vdev->devname != NULL && vdev->mountable);
 
+    vfs_dcache_purge();
     if ((ret = fsop_sync(vdev->fs)) != 0) {
         goto out;
     }
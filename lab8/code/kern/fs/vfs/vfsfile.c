@@ -44,6 +44,7 @@ vfs_open(char *path, uint32_t open_flags, struct inode **node_store) {
                 return ret;
             }
             ret = vop_create(dir, name, excl, &node);//创建inode
+            vfs_dcache_invalidate(dir, name);//名字缓存里可能有这个名字的负项
         } else return ret;
     } else if (excl && create) {
         return -E_EXISTS;
@@ -75,13 +76,13 @@ vfs_close(struct inode *node) {
     return 0;
 }
 
-// unimplement
+// unimplement (an implementation must vfs_dcache_invalidate the name it removes)
 int
 vfs_unlink(char *path) {
     return -E_UNIMP;
 }
 
-// unimplement
+// unimplement (an implementation must vfs_dcache_invalidate both names)
 int
 vfs_rename(char *old_path, char *new_path) {
     return -E_UNIMP;
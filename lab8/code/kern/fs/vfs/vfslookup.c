@@ -84,7 +84,16 @@ vfs_lookup(char *path, struct inode **node_store) {
         return ret;                                   //这个变量在init_main函数（位于kern/process/proc.c）执行时获得了赋值。
     }
     if (*path != '\0') {//通过调用vop_lookup函数来查找到根目录“/”下对应文件sfs_filetest1的索引节点，如果找到就返回此索引节点。
-        ret = vop_lookup(node, path, node_store);//这个会再去调用这个node对应的sys_lookup,如果是设备node那就去找设备的lookup,这个宏对应哪个函数在这个node创建时候就初始化好了
+        // 先查名字缓存, 不存在的名字也会被缓存(负项), 重复查找同一路径不再走到具体文件系统
+        if (vfs_dcache_lookup(node, path, node_store)) {
+            ret = (*node_store != NULL) ? 0 : -E_NOENT;
+        }
+        else {
+            ret = vop_lookup(node, path, node_store);//这个会再去调用这个node对应的sys_lookup,如果是设备node那就去找设备的lookup,这个宏对应哪个函数在这个node创建时候就初始化好了
+            if (ret == 0 || ret == -E_NOENT) {
+                vfs_dcache_add(node, path, (ret == 0) ? *node_store : NULL);
+            }
+        }
         vop_ref_dec(node);
         return ret;
     }
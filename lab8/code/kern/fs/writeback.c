@@ -0,0 +1,39 @@
+#include <defs.h>
+#include <stdio.h>
+#include <vfs.h>
+#include <bcache.h>
+#include <proc.h>
+#include <writeback.h>
+#include <assert.h>
+
+size_t wb_interval = WB_INTERVAL;
+size_t wb_dirty_expire = WB_DIRTY_EXPIRE;
+size_t wb_dirty_ratio = WB_DIRTY_RATIO;
+
+static volatile bool wb_stopping = 0;
+
+/*
+ * writeback_main - the writeback daemon, started by init_main with kernel_thread.
+ *                  everything still dirty is flushed before it exits.
+ */
+int
+writeback_main(void *arg) {
+    int ret;
+    while (!wb_stopping) {
+        do_sleep(wb_interval);
+        if ((ret = vfs_writeback()) != 0 || (ret = bcache_writeback(wb_dirty_expire, wb_dirty_ratio)) != 0) {
+            warn("writeback: %e.\n", ret);
+        }
+    }
+    vfs_writeback();
+    return bcache_writeback(0, 0);
+}
+
+/*
+ * writeback_stop - ask the daemon to exit, it does so the next time it wakes up.
+ *                  the caller then reaps it with do_wait.
+ */
+void
+writeback_stop(void) {
+    wb_stopping = 1;
+}
@@ -0,0 +1,25 @@
+#ifndef __KERN_FS_WRITEBACK_H__
+#define __KERN_FS_WRITEBACK_H__
+
+#include <defs.h>
+
+/*
+ * Writeback daemon: a kernel thread which wakes up every wb_interval ticks,
+ * writes dirty file data and inodes of all mounted fs back, and flushes the
+ * dirty cached blocks that have been dirty for wb_dirty_expire ticks (or all
+ * of them when more than wb_dirty_ratio percent of the buffer cache is dirty).
+ * Writers only dirty memory, so write() and close() return without disk I/O.
+ */
+
+#define WB_INTERVAL                     50          /* default wake up interval, in ticks */
+#define WB_DIRTY_EXPIRE                 300         /* default age of a dirty block before it is written */
+#define WB_DIRTY_RATIO                  50          /* default % of dirty blocks forcing a full flush */
+
+extern size_t wb_interval;
+extern size_t wb_dirty_expire;
+extern size_t wb_dirty_ratio;
+
+int writeback_main(void *arg);
+void writeback_stop(void);
+
+#endif /* !__KERN_FS_WRITEBACK_H__ */
@@ -0,0 +1,399 @@
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <kmalloc.h>
+#include <rb_tree.h>
+#include <assert.h>
+
+/* rb_tree_create - alloc an empty red-black tree sorted by @compare, NULL if out of memory */
+rb_tree *
+rb_tree_create(int (*compare)(rb_node *node1, rb_node *node2)) {
+    assert(compare != NULL);
+    rb_tree *tree;
+    rb_node *nil;
+    if ((tree = kmalloc(sizeof(rb_tree))) == NULL) {
+        goto bad_tree;
+    }
+    if ((nil = kmalloc(sizeof(rb_node))) == NULL) {
+        goto bad_node_cleanup_tree;
+    }
+    nil->red = 0;
+    nil->parent = nil->left = nil->right = nil;
+    tree->compare = compare;
+    tree->nil = tree->root = nil;
+    return tree;
+
+bad_node_cleanup_tree:
+    kfree(tree);
+bad_tree:
+    return NULL;
+}
+
+/* rb_tree_destroy - free the tree, the nodes belong to their owners and are left alone */
+void
+rb_tree_destroy(rb_tree *tree) {
+    kfree(tree->nil);
+    kfree(tree);
+}
+
+static void
+rb_left_rotate(rb_tree *tree, rb_node *x) {
+    rb_node *nil = tree->nil, *y = x->right;
+    x->right = y->left;
+    if (y->left != nil) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    if (x->parent == nil) {
+        tree->root = y;
+    }
+    else if (x == x->parent->left) {
+        x->parent->left = y;
+    }
+    else {
+        x->parent->right = y;
+    }
+    y->left = x;
+    x->parent = y;
+}
+
+static void
+rb_right_rotate(rb_tree *tree, rb_node *x) {
+    rb_node *nil = tree->nil, *y = x->left;
+    x->left = y->right;
+    if (y->right != nil) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    if (x->parent == nil) {
+        tree->root = y;
+    }
+    else if (x == x->parent->right) {
+        x->parent->right = y;
+    }
+    else {
+        x->parent->left = y;
+    }
+    y->right = x;
+    x->parent = y;
+}
+
+/* rb_insert - add @node to the tree, nodes comparing equal keep their insertion order */
+void
+rb_insert(rb_tree *tree, rb_node *node) {
+    rb_node *nil = tree->nil, *x = tree->root, *y = nil;
+    while (x != nil) {
+        y = x;
+        x = (tree->compare(node, x) < 0) ? x->left : x->right;
+    }
+    node->parent = y;
+    if (y == nil) {
+        tree->root = node;
+    }
+    else if (tree->compare(node, y) < 0) {
+        y->left = node;
+    }
+    else {
+        y->right = node;
+    }
+    node->left = node->right = nil;
+    node->red = 1;
+
+    // a red node may not have a red parent
+    while (node->parent->red) {
+        rb_node *parent = node->parent, *gparent = parent->parent;
+        if (parent == gparent->left) {
+            y = gparent->right;
+            if (y->red) {
+                parent->red = y->red = 0, gparent->red = 1;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                node = parent;
+                rb_left_rotate(tree, node);
+            }
+            node->parent->red = 0, node->parent->parent->red = 1;
+            rb_right_rotate(tree, node->parent->parent);
+        }
+        else {
+            y = gparent->left;
+            if (y->red) {
+                parent->red = y->red = 0, gparent->red = 1;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                node = parent;
+                rb_right_rotate(tree, node);
+            }
+            node->parent->red = 0, node->parent->parent->red = 1;
+            rb_left_rotate(tree, node->parent->parent);
+        }
+    }
+    tree->root->red = 0;
+}
+
+// rb_transplant - put @v where @u is in the tree
+static void
+rb_transplant(rb_tree *tree, rb_node *u, rb_node *v) {
+    if (u->parent == tree->nil) {
+        tree->root = v;
+    }
+    else if (u == u->parent->left) {
+        u->parent->left = v;
+    }
+    else {
+        u->parent->right = v;
+    }
+    v->parent = u->parent;
+}
+
+static rb_node *
+rb_minimum(rb_tree *tree, rb_node *node) {
+    while (node->left != tree->nil) {
+        node = node->left;
+    }
+    return node;
+}
+
+// rb_delete_fixup - @x took the place of a removed black node and carries an extra black
+static void
+rb_delete_fixup(rb_tree *tree, rb_node *x) {
+    rb_node *w;
+    while (x != tree->root && !x->red) {
+        if (x == x->parent->left) {
+            w = x->parent->right;
+            if (w->red) {
+                w->red = 0, x->parent->red = 1;
+                rb_left_rotate(tree, x->parent);
+                w = x->parent->right;
+            }
+            if (!w->left->red && !w->right->red) {
+                w->red = 1;
+                x = x->parent;
+                continue;
+            }
+            if (!w->right->red) {
+                w->left->red = 0, w->red = 1;
+                rb_right_rotate(tree, w);
+                w = x->parent->right;
+            }
+            w->red = x->parent->red;
+            x->parent->red = w->right->red = 0;
+            rb_left_rotate(tree, x->parent);
+            x = tree->root;
+        }
+        else {
+            w = x->parent->left;
+            if (w->red) {
+                w->red = 0, x->parent->red = 1;
+                rb_right_rotate(tree, x->parent);
+                w = x->parent->left;
+            }
+            if (!w->left->red && !w->right->red) {
+                w->red = 1;
+                x = x->parent;
+                continue;
+            }
+            if (!w->left->red) {
+                w->right->red = 0, w->red = 1;
+                rb_left_rotate(tree, w);
+                w = x->parent->left;
+            }
+            w->red = x->parent->red;
+            x->parent->red = w->left->red = 0;
+            rb_right_rotate(tree, x->parent);
+            x = tree->root;
+        }
+    }
+    x->red = 0;
+}
+
+/* rb_delete - take @node out of the tree */
+void
+rb_delete(rb_tree *tree, rb_node *node) {
+    rb_node *nil = tree->nil, *x, *y = node;
+    bool y_red = y->red;
+    if (node->left == nil) {
+        x = node->right;
+        rb_transplant(tree, node, node->right);
+    }
+    else if (node->right == nil) {
+        x = node->left;
+        rb_transplant(tree, node, node->left);
+    }
+    else {
+        // the successor of node takes its place and color
+        y = rb_minimum(tree, node->right);
+        y_red = y->red;
+        x = y->right;
+        if (y->parent == node) {
+            x->parent = y;
+        }
+        else {
+            rb_transplant(tree, y, y->right);
+            y->right = node->right;
+            y->right->parent = y;
+        }
+        rb_transplant(tree, node, y);
+        y->left = node->left;
+        y->left->parent = y;
+        y->red = node->red;
+    }
+    if (!y_red) {
+        rb_delete_fixup(tree, x);
+    }
+    // the fixup may have used nil as a temporary parent link
+    nil->parent = nil;
+}
+
+/*
+ * rb_search - find a node matching @key, NULL if there is none.
+ *             @compare tells if @node sorts before (<0), matches (0) or sorts after (>0) @key.
+ */
+rb_node *
+rb_search(rb_tree *tree, int (*compare)(rb_node *node, void *key), void *key) {
+    rb_node *nil = tree->nil, *node = tree->root;
+    int r;
+    while (node != nil && (r = compare(node, key)) != 0) {
+        node = (r > 0) ? node->left : node->right;
+    }
+    return (node == nil) ? NULL : node;
+}
+
+/* rb_node_prev - the node sorted just before @node, NULL if @node is the first one */
+rb_node *
+rb_node_prev(rb_tree *tree, rb_node *node) {
+    rb_node *nil = tree->nil, *y;
+    if (node->left != nil) {
+        node = node->left;
+        while (node->right != nil) {
+            node = node->right;
+        }
+        return node;
+    }
+    y = node->parent;
+    while (y != nil && node == y->left) {
+        node = y, y = y->parent;
+    }
+    return (y == nil) ? NULL : y;
+}
+
+/* rb_node_next - the node sorted just after @node, NULL if @node is the last one */
+rb_node *
+rb_node_next(rb_tree *tree, rb_node *node) {
+    rb_node *nil = tree->nil, *y;
+    if (node->right != nil) {
+        return rb_minimum(tree, node->right);
+    }
+    y = node->parent;
+    while (y != nil && node == y->right) {
+        node = y, y = y->parent;
+    }
+    return (y == nil) ? NULL : y;
+}
+
+/* rb_node_first - the first node of the tree, NULL if it is empty */
+rb_node *
+rb_node_first(rb_tree *tree) {
+    return (tree->root == tree->nil) ? NULL : rb_minimum(tree, tree->root);
+}
+
+/* ------------------------------------------------------------------ */
+
+#define CHECK_RB_NODES          500
+
+struct check_data {
+    long key;
+    rb_node rb_link;
+};
+
+#define rbn2data(node)          rbn2struct(node, struct check_data, rb_link)
+
+static int
+check_compare1(rb_node *node1, rb_node *node2) {
+    long k1 = rbn2data(node1)->key, k2 = rbn2data(node2)->key;
+    return (k1 < k2) ? -1 : (k1 > k2) ? 1 : 0;
+}
+
+static int
+check_compare2(rb_node *node, void *key) {
+    long k1 = rbn2data(node)->key, k2 = (long)key;
+    return (k1 < k2) ? -1 : (k1 > k2) ? 1 : 0;
+}
+
+// check_subtree - check the red-black properties below @node, return its black height
+static int
+check_subtree(rb_tree *tree, rb_node *node) {
+    if (node == tree->nil) {
+        return 1;
+    }
+    if (node->red) {
+        assert(!node->left->red && !node->right->red);
+    }
+    if (node->left != tree->nil) {
+        assert(node->left->parent == node && check_compare1(node->left, node) <= 0);
+    }
+    if (node->right != tree->nil) {
+        assert(node->right->parent == node && check_compare1(node, node->right) <= 0);
+    }
+    int hl = check_subtree(tree, node->left), hr = check_subtree(tree, node->right);
+    assert(hl == hr);
+    return hl + (node->red ? 0 : 1);
+}
+
+static void
+check_tree(rb_tree *tree, int n) {
+    assert(!tree->root->red && !tree->nil->red && tree->root->parent == tree->nil);
+    check_subtree(tree, tree->root);
+    rb_node *node = rb_node_first(tree), *prev = NULL;
+    int count = 0;
+    for (; node != NULL; prev = node, node = rb_node_next(tree, node), count ++) {
+        assert(rb_node_prev(tree, node) == prev);
+        if (prev != NULL) {
+            assert(check_compare1(prev, node) <= 0);
+        }
+    }
+    assert(count == n);
+}
+
+void
+check_rb_tree(void) {
+    rb_tree *tree = rb_tree_create(check_compare1);
+    assert(tree != NULL);
+
+    struct check_data *all = kmalloc(sizeof(struct check_data) * CHECK_RB_NODES);
+    assert(all != NULL);
+
+    int i;
+    for (i = 0; i < CHECK_RB_NODES; i ++) {
+        all[i].key = (i * 7919) % CHECK_RB_NODES;
+        rb_insert(tree, &(all[i].rb_link));
+    }
+    check_tree(tree, CHECK_RB_NODES);
+
+    for (i = 0; i < CHECK_RB_NODES; i ++) {
+        rb_node *node = rb_search(tree, check_compare2, (void *)(long)i);
+        assert(node != NULL && rbn2data(node)->key == i);
+    }
+    assert(rb_search(tree, check_compare2, (void *)(long)CHECK_RB_NODES) == NULL);
+
+    // delete every other node, then the rest
+    for (i = 0; i < CHECK_RB_NODES; i += 2) {
+        rb_delete(tree, &(all[i].rb_link));
+    }
+    check_tree(tree, CHECK_RB_NODES / 2);
+    for (i = 1; i < CHECK_RB_NODES; i += 2) {
+        assert(rb_search(tree, check_compare2, (void *)all[i].key) == &(all[i].rb_link));
+        rb_delete(tree, &(all[i].rb_link));
+    }
+    check_tree(tree, 0);
+    assert(rb_node_root(tree) == NULL);
+
+    kfree(all);
+    rb_tree_destroy(tree);
+
+    cprintf("check_rb_tree() succeeded!\n");
+}
+
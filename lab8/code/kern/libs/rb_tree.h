@@ -0,0 +1,55 @@
+#ifndef __KERN_LIBS_RB_TREE_H__
+#define __KERN_LIBS_RB_TREE_H__
+
+#include <defs.h>
+
+/*
+ * red-black tree, the node is embedded in the structure it sorts (like list_entry_t),
+ * ordered by the compare function given to rb_tree_create.
+ * every leaf is the tree's sentinel node nil, the helpers below hand back NULL instead.
+ */
+
+typedef struct rb_node rb_node;
+
+struct rb_node {
+    bool red;                           // if red = 0, it's a black node
+    rb_node *parent;
+    rb_node *left, *right;
+};
+
+typedef struct rb_tree {
+    int (*compare)(rb_node *node1, rb_node *node2); // <0, 0, >0 if node1 sorts before, with, after node2
+    rb_node *nil, *root;                // root is nil if the tree is empty
+} rb_tree;
+
+#define rbn2struct(node, type, member)          \
+    to_struct((node), type, member)
+
+rb_tree *rb_tree_create(int (*compare)(rb_node *node1, rb_node *node2));
+void rb_tree_destroy(rb_tree *tree);
+void rb_insert(rb_tree *tree, rb_node *node);
+void rb_delete(rb_tree *tree, rb_node *node);
+rb_node *rb_search(rb_tree *tree, int (*compare)(rb_node *node, void *key), void *key);
+rb_node *rb_node_prev(rb_tree *tree, rb_node *node);
+rb_node *rb_node_next(rb_tree *tree, rb_node *node);
+rb_node *rb_node_first(rb_tree *tree);
+
+static inline rb_node *
+rb_node_root(rb_tree *tree) {
+    return (tree->root == tree->nil) ? NULL : tree->root;
+}
+
+static inline rb_node *
+rb_node_left(rb_tree *tree, rb_node *node) {
+    return (node->left == tree->nil) ? NULL : node->left;
+}
+
+static inline rb_node *
+rb_node_right(rb_tree *tree, rb_node *node) {
+    return (node->right == tree->nil) ? NULL : node->right;
+}
+
+void check_rb_tree(void);
+
+#endif /* !__KERN_LIBS_RB_TREE_H__ */
+
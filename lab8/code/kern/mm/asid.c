@@ -0,0 +1,52 @@
+#include <defs.h>
+#include <stdio.h>
+#include <riscv.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <asid.h>
+#include <assert.h>
+
+static uint64_t asid_mask;          // the largest ASID the hart supports, 0 if it has none
+static uint64_t asid_generation;    // the current generation, a multiple of asid_mask + 1
+static uint64_t next_asid;          // the next free ASID of the current generation
+
+// asid_init - find out how many ASID bits the hart implements, the ones it lacks read back as 0
+void
+asid_init(void) {
+    uintptr_t satp = read_csr(satp);
+    write_csr(satp, satp | SATP64_ASID);
+    asid_mask = (read_csr(satp) & SATP64_ASID) >> SATP64_ASID_SHIFT;
+    write_csr(satp, satp);
+
+    asid_generation = asid_mask + 1;
+    next_asid = 1;
+    cprintf("asid: %d ASIDs for address spaces.\n", asid_mask);
+}
+
+/*
+ * switch_mm - run on the page table of @mm, under its ASID. an mm without an ASID of the
+ *             current generation gets a new one, starting a new generation (and flushing
+ *             the whole TLB) if there is none left.
+ */
+void
+switch_mm(struct mm_struct *mm) {
+    bool flush = 0;
+    if (asid_mask == 0) {
+        // no ASIDs, entries of the previous address space must go
+        flush = 1;
+    }
+    else if ((mm->context & ~asid_mask) != asid_generation) {
+        if (next_asid > asid_mask) {
+            asid_generation += asid_mask + 1;
+            next_asid = 1;
+            flush = 1;
+        }
+        mm->context = asid_generation | next_asid ++;
+    }
+    lcr3_asid(PADDR(mm->pgdir), mm->context & asid_mask);
+    // flush after the switch: nothing may refill an entry of an old ASID afterwards
+    if (flush) {
+        flush_tlb();
+    }
+}
+
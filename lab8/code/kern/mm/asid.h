@@ -0,0 +1,25 @@
+#ifndef __KERN_MM_ASID_H__
+#define __KERN_MM_ASID_H__
+
+#include <defs.h>
+
+struct mm_struct;
+
+/*
+ * Address space identifiers: every mm runs under an ASID of its own, which tags
+ * its TLB entries, so switching between processes keeps the TLB instead of
+ * flushing it, and tlb_invalidate only drops the entry of the running ASID.
+ *
+ * ASIDs are handed out in generations: mm->context holds the generation the
+ * mm's ASID was allocated in (above the ASID bits) and the ASID itself. When
+ * all ASIDs of a generation are used up the whole TLB is flushed once and a
+ * new generation starts; an mm whose ASID is from an older generation gets a
+ * new one the next time it is switched to. ASID 0 is used by boot_pgdir
+ * (kernel threads), it is never given to an mm.
+ */
+
+void asid_init(void);
+void switch_mm(struct mm_struct *mm);
+
+#endif /* !__KERN_MM_ASID_H__ */
+
@@ -0,0 +1,268 @@
+#include <pmm.h>
+#include <list.h>
+#include <string.h>
+#include <stdio.h>
+#include <buddy_pmm.h>
+
+/*
+ * Buddy system page allocator.
+ *
+ * Free memory is kept as blocks of 2^order pages, each block aligned to its own
+ * size in physical page numbers, on one free list per order. The head page of a
+ * free block has PG_property set and its order in property.
+ *
+ * alloc takes the first block of the smallest order big enough and splits it in
+ * halves down to the order asked for, putting every upper half back on the list
+ * of its order. free merges a block with its buddy (the block at ppn ^ 2^order)
+ * for as long as the buddy is a free block of the same order. Both take at most
+ * BUDDY_MAX_ORDER steps, whatever the fragmentation of memory.
+ *
+ * A request which is not a power of two is served by the next power of two, the
+ * pages past the request are freed again at once, so alloc_pages(n) and
+ * free_pages(base, n) take exactly n pages, as with default_pmm.
+ */
+
+static free_area_t buddy_area[BUDDY_MAX_ORDER];
+static size_t nr_free;
+
+// the pages handed to init_memmap, no buddy lies outside of them
+static struct Page *buddy_base, *buddy_end;
+
+#define buddy_list(order)           (buddy_area[(order)].free_list)
+
+static void
+buddy_init(void) {
+    int order;
+    for (order = 0; order < BUDDY_MAX_ORDER; order ++) {
+        list_init(&buddy_list(order));
+        buddy_area[order].nr_free = 0;
+    }
+    nr_free = 0;
+    buddy_base = buddy_end = NULL;
+}
+
+static inline void
+buddy_add_block(struct Page *page, int order) {
+    page->property = order;
+    SetPageProperty(page);
+    list_add(&buddy_list(order), &(page->page_link));
+    buddy_area[order].nr_free ++;
+}
+
+static inline void
+buddy_del_block(struct Page *page, int order) {
+    list_del(&(page->page_link));
+    ClearPageProperty(page);
+    buddy_area[order].nr_free --;
+}
+
+// buddy_of - the buddy of the block of 2^@order pages at @page, NULL if it is not a free block of that order
+static struct Page *
+buddy_of(struct Page *page, int order) {
+    ppn_t ppn = page2ppn(page) ^ (1 << order);
+    struct Page *buddy = page + ((long)ppn - (long)page2ppn(page));
+    if (buddy < buddy_base || buddy + (1 << order) > buddy_end) {
+        return NULL;
+    }
+    if (!PageProperty(buddy) || buddy->property != order) {
+        return NULL;
+    }
+    return buddy;
+}
+
+// buddy_free_block - give back the block of 2^@order pages at @page, merged with its buddies
+static void
+buddy_free_block(struct Page *page, int order) {
+    struct Page *buddy;
+    while (order < BUDDY_MAX_ORDER - 1 && (buddy = buddy_of(page, order)) != NULL) {
+        buddy_del_block(buddy, order);
+        if (buddy < page) {
+            page = buddy;
+        }
+        order ++;
+    }
+    buddy_add_block(page, order);
+}
+
+// buddy_free_range - give back the @n pages at @base, cut into the largest aligned blocks
+static void
+buddy_free_range(struct Page *base, size_t n) {
+    while (n != 0) {
+        int order = 0;
+        ppn_t ppn = page2ppn(base);
+        while (order < BUDDY_MAX_ORDER - 1 && !(ppn & (1 << order)) && (2 << order) <= n) {
+            order ++;
+        }
+        buddy_free_block(base, order);
+        base += (1 << order), n -= (1 << order);
+    }
+}
+
+static void
+buddy_init_memmap(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(PageReserved(p));
+        p->flags = p->property = 0;
+        set_page_ref(p, 0);
+    }
+    if (buddy_base == NULL || base < buddy_base) {
+        buddy_base = base;
+    }
+    if (buddy_end == NULL || base + n > buddy_end) {
+        buddy_end = base + n;
+    }
+    nr_free += n;
+    buddy_free_range(base, n);
+}
+
+static struct Page *
+buddy_alloc_pages(size_t n) {
+    assert(n > 0);
+    if (n > nr_free || n > (1 << (BUDDY_MAX_ORDER - 1))) {
+        return NULL;
+    }
+    int order = 0, cur;
+    while ((1 << order) < n) {
+        order ++;
+    }
+    for (cur = order; cur < BUDDY_MAX_ORDER; cur ++) {
+        if (!list_empty(&buddy_list(cur))) {
+            break;
+        }
+    }
+    if (cur == BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+
+    struct Page *page = le2page(list_next(&buddy_list(cur)), page_link);
+    buddy_del_block(page, cur);
+    // split, keeping the lower half
+    while (cur > order) {
+        cur --;
+        buddy_add_block(page + (1 << cur), cur);
+    }
+    nr_free -= n;
+    if (n < (1 << order)) {
+        buddy_free_range(page + n, (1 << order) - n);
+    }
+    return page;
+}
+
+static void
+buddy_free_pages(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(!PageReserved(p) && !PageProperty(p));
+        p->flags = 0;
+        set_page_ref(p, 0);
+    }
+    nr_free += n;
+    buddy_free_range(base, n);
+}
+
+static size_t
+buddy_nr_free_pages(void) {
+    return nr_free;
+}
+
+// buddy_snapshot - the # of free blocks of each order
+static void
+buddy_snapshot(unsigned int *nr_blocks) {
+    int order;
+    for (order = 0; order < BUDDY_MAX_ORDER; order ++) {
+        nr_blocks[order] = buddy_area[order].nr_free;
+    }
+}
+
+static void
+buddy_check_snapshot(unsigned int *nr_blocks) {
+    unsigned int now[BUDDY_MAX_ORDER];
+    buddy_snapshot(now);
+    assert(memcmp(now, nr_blocks, sizeof(now)) == 0);
+}
+
+#define CHECK_PAGES                 64
+
+static void
+buddy_check(void) {
+    // the free lists agree with the counters and the alignment rule
+    size_t total = 0;
+    int order;
+    for (order = 0; order < BUDDY_MAX_ORDER; order ++) {
+        unsigned int count = 0;
+        list_entry_t *le = &buddy_list(order);
+        while ((le = list_next(le)) != &buddy_list(order)) {
+            struct Page *p = le2page(le, page_link);
+            assert(PageProperty(p) && p->property == order);
+            assert((page2ppn(p) & ((1 << order) - 1)) == 0);
+            count ++, total += (1 << order);
+        }
+        assert(count == buddy_area[order].nr_free);
+    }
+    assert(total == nr_free_pages());
+
+    unsigned int nr_blocks[BUDDY_MAX_ORDER];
+    buddy_snapshot(nr_blocks);
+    size_t nr_free_store = nr_free;
+
+    struct Page *p0, *p1, *p2;
+    assert((p0 = buddy_alloc_pages(1)) != NULL);
+    assert((p1 = buddy_alloc_pages(1)) != NULL);
+    assert((p2 = buddy_alloc_pages(1)) != NULL);
+    assert(p0 != p1 && p0 != p2 && p1 != p2);
+    assert(page_ref(p0) == 0 && page_ref(p1) == 0 && page_ref(p2) == 0);
+    assert(!PageProperty(p0) && !PageProperty(p1) && !PageProperty(p2));
+    assert(nr_free == nr_free_store - 3);
+    buddy_free_pages(p0, 1);
+    buddy_free_pages(p2, 1);
+    buddy_free_pages(p1, 1);
+    // everything is merged back into the blocks it came from
+    buddy_check_snapshot(nr_blocks);
+
+    // blocks are aligned to their size
+    for (order = 0; order < BUDDY_MAX_ORDER; order ++) {
+        if ((p0 = buddy_alloc_pages(1 << order)) == NULL) {
+            break;
+        }
+        assert((page2ppn(p0) & ((1 << order) - 1)) == 0);
+        buddy_free_pages(p0, 1 << order);
+    }
+    buddy_check_snapshot(nr_blocks);
+
+    // a request of 3 pages takes 3 pages, the 4th one stays free
+    assert((p0 = buddy_alloc_pages(3)) != NULL);
+    assert(nr_free == nr_free_store - 3);
+    assert((p1 = buddy_alloc_pages(1)) == p0 + 3);
+    buddy_free_pages(p1, 1);
+    buddy_free_pages(p0 + 1, 2);
+    buddy_free_pages(p0, 1);
+    buddy_check_snapshot(nr_blocks);
+
+    // split memory into single pages, free every other one, then the rest
+    struct Page *check[CHECK_PAGES];
+    int i;
+    for (i = 0; i < CHECK_PAGES; i ++) {
+        assert((check[i] = buddy_alloc_pages(1)) != NULL);
+    }
+    for (i = 0; i < CHECK_PAGES; i += 2) {
+        buddy_free_pages(check[i], 1);
+    }
+    for (i = 1; i < CHECK_PAGES; i += 2) {
+        buddy_free_pages(check[i], 1);
+    }
+    buddy_check_snapshot(nr_blocks);
+    assert(nr_free == nr_free_store);
+}
+
+const struct pmm_manager buddy_pmm_manager = {
+    .name = "buddy_pmm_manager",
+    .init = buddy_init,
+    .init_memmap = buddy_init_memmap,
+    .alloc_pages = buddy_alloc_pages,
+    .free_pages = buddy_free_pages,
+    .nr_free_pages = buddy_nr_free_pages,
+    .check = buddy_check,
+};
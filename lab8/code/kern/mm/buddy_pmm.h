@@ -0,0 +1,10 @@
+#ifndef __KERN_MM_BUDDY_PMM_H__
+#define  __KERN_MM_BUDDY_PMM_H__
+
+#include <pmm.h>
+
+#define BUDDY_MAX_ORDER             11      /* free blocks are 2^0 .. 2^10 pages */
+
+extern const struct pmm_manager buddy_pmm_manager;
+
+#endif /* ! __KERN_MM_BUDDY_PMM_H__ */
@@ -3,303 +3,216 @@
 #include <memlayout.h>
 #include <assert.h>
 #include <kmalloc.h>
+#include <slab.h>
+#include <slob.h>
 #include <sync.h>
 #include <pmm.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <riscv.h>
 
 /*
- * SLOB Allocator: Simple List Of Blocks
+ * kmalloc: size-class segregated allocator.
  *
- * Matt Mackall <mpm@selenic.com> 12/30/03
- *
- * How SLOB works:
- *
- * The core of SLOB is a traditional K&R style heap allocator, with
- * support for returning aligned objects. The granularity of this
- * allocator is 8 bytes on x86, though it's perhaps possible to reduce
- * this to 4 if it's deemed worth the effort. The slob heap is a
- * singly-linked list of pages from __get_free_page, grown on demand
- * and allocation from the heap is currently first-fit.
- *
- * Above this is an implementation of kmalloc/kfree. Blocks returned
- * from kmalloc are 8-byte aligned and prepended with a 8-byte header.
- * If kmalloc is asked for objects of PAGE_SIZE or larger, it calls
- * __get_free_pages directly so that it can return page-aligned blocks
- * and keeps a linked list of such pages and their orders. These
- * objects are detected in kfree() by their page alignment.
- *
- * SLAB is emulated on top of SLOB by simply calling constructors and
- * destructors for every SLAB allocation. Objects are returned with
- * the 8-byte alignment unless the SLAB_MUST_HWCACHE_ALIGN flag is
- * set, in which case the low-level allocator will fragment blocks to
- * create the proper alignment. Again, objects of page-size or greater
- * are allocated by calling __get_free_pages. As SLAB objects know
- * their size, no separate size bookkeeping is necessary and there is
- * essentially no allocation space overhead.
+ * Requests up to KMALLOC_MAX_SMALL bytes are rounded up to a power of two and
+ * served by the slab cache of that size, so both kmalloc and kfree take constant
+ * time. Larger requests get whole pages from pmm, the # of pages is kept in the
+ * struct Page of the first one. The two kinds are told apart by the address:
+ * a slab object never starts on a page boundary (the slab header is there),
+ * a large block always does.
  */
 
+static struct kmem_cache *kmalloc_caches[KMALLOC_NCLASS];
+static size_t kmalloc_bytes;
 
-//some helper
-#define spin_lock_irqsave(l, f) local_intr_save(f)
-#define spin_unlock_irqrestore(l, f) local_intr_restore(f)
-typedef unsigned int gfp_t;
-#ifndef PAGE_SIZE
-#define PAGE_SIZE PGSIZE
-#endif
-
-#ifndef L1_CACHE_BYTES
-#define L1_CACHE_BYTES 64
-#endif
-
-#ifndef ALIGN
-#define ALIGN(addr,size)   (((addr)+(size)-1)&(~((size)-1))) 
-#endif
-
-
-struct slob_block {
-	int units;
-	struct slob_block *next;
+static const char *kmalloc_names[KMALLOC_NCLASS] = {
+    "size-16", "size-32", "size-64", "size-128", "size-256", "size-512", "size-1024",
 };
-typedef struct slob_block slob_t;
-
-#define SLOB_UNIT sizeof(slob_t)
-#define SLOB_UNITS(size) (((size) + SLOB_UNIT - 1)/SLOB_UNIT)
-#define SLOB_ALIGN L1_CACHE_BYTES
-
-struct bigblock {
-	int order;
-	void *pages;
-	struct bigblock *next;
-};
-typedef struct bigblock bigblock_t;
-
-static slob_t arena = { .next = &arena, .units = 1 };
-static slob_t *slobfree = &arena;
-static bigblock_t *bigblocks;
-
-
-static void* __slob_get_free_pages(gfp_t gfp, int order)
-{
-  struct Page * page = alloc_pages(1 << order);
-  if(!page)
-    return NULL;
-  return page2kva(page);
-}
 
-#define __slob_get_free_page(gfp) __slob_get_free_pages(gfp, 0)
-
-static inline void __slob_free_pages(unsigned long kva, int order)
-{
-  free_pages(kva2page(kva), 1 << order);
+static inline size_t
+kmalloc_class_size(int i) {
+    return KMALLOC_MIN_SMALL << i;
 }
 
-static void slob_free(void *b, int size);
-
-static void *slob_alloc(size_t size, gfp_t gfp, int align)
-{
-  assert( (size + SLOB_UNIT) < PAGE_SIZE );
-
-	slob_t *prev, *cur, *aligned = 0;
-	int delta = 0, units = SLOB_UNITS(size);
-	unsigned long flags;
-
-	spin_lock_irqsave(&slob_lock, flags);
-	prev = slobfree;
-	for (cur = prev->next; ; prev = cur, cur = cur->next) {
-		if (align) {
-			aligned = (slob_t *)ALIGN((unsigned long)cur, align);
-			delta = aligned - cur;
-		}
-		if (cur->units >= units + delta) { /* room enough? */
-			if (delta) { /* need to fragment head to align? */
-				aligned->units = cur->units - delta;
-				aligned->next = cur->next;
-				cur->next = aligned;
-				cur->units = delta;
-				prev = cur;
-				cur = aligned;
-			}
-
-			if (cur->units == units) /* exact fit? */
-				prev->next = cur->next; /* unlink */
-			else { /* fragment */
-				prev->next = cur + units;
-				prev->next->units = cur->units - units;
-				prev->next->next = cur->next;
-				cur->units = units;
-			}
-
-			slobfree = prev;
-			spin_unlock_irqrestore(&slob_lock, flags);
-			return cur;
-		}
-		if (cur == slobfree) {
-			spin_unlock_irqrestore(&slob_lock, flags);
-
-			if (size == PAGE_SIZE) /* trying to shrink arena? */
-				return 0;
-
-			cur = (slob_t *)__slob_get_free_page(gfp);
-			if (!cur)
-				return 0;
-
-			slob_free(cur, PAGE_SIZE);
-			spin_lock_irqsave(&slob_lock, flags);
-			cur = slobfree;
-		}
-	}
+static inline int
+kmalloc_class(size_t size) {
+    int i = 0;
+    while (kmalloc_class_size(i) < size) {
+        i ++;
+    }
+    return i;
 }
 
-static void slob_free(void *block, int size)
-{
-	slob_t *cur, *b = (slob_t *)block;
-	unsigned long flags;
-
-	if (!block)
-		return;
-
-	if (size)
-		b->units = SLOB_UNITS(size);
-
-	/* Find reinsertion point */
-	spin_lock_irqsave(&slob_lock, flags);
-	for (cur = slobfree; !(b > cur && b < cur->next); cur = cur->next)
-		if (cur >= cur->next && (b > cur || b < cur->next))
-			break;
-
-	if (b + b->units == cur->next) {
-		b->units += cur->next->units;
-		b->next = cur->next->next;
-	} else
-		b->next = cur->next;
-
-	if (cur + cur->units == b) {
-		cur->units += b->units;
-		cur->next = b->next;
-	} else
-		cur->next = b;
-
-	slobfree = cur;
-
-	spin_unlock_irqrestore(&slob_lock, flags);
-}
-
-
+static void check_kmalloc(void);
 
 void
-slob_init(void) {
-  cprintf("use SLOB allocator\n");
-}
-
-inline void 
 kmalloc_init(void) {
-    slob_init();
+    kmem_cache_init();
+    int i;
+    for (i = 0; i < KMALLOC_NCLASS; i ++) {
+        if ((kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], kmalloc_class_size(i), NULL)) == NULL) {
+            panic("cannot create kmalloc cache %s.\n", kmalloc_names[i]);
+        }
+    }
+    check_slab();
+    check_kmalloc();
     cprintf("kmalloc_init() succeeded!\n");
 }
 
-size_t
-slob_allocated(void) {
-  return 0;
-}
-
+/* kallocated - # of bytes in use by kmalloc, rounded up to the size classes/pages */
 size_t
 kallocated(void) {
-   return slob_allocated();
+    return kmalloc_bytes;
 }
 
-static int find_order(int size)
-{
-	int order = 0;
-	for ( ; size > 4096 ; size >>=1)
-		order++;
-	return order;
+void *
+kmalloc(size_t size) {
+    void *objp;
+    bool intr_flag;
+    if (size <= KMALLOC_MAX_SMALL) {
+        int i = kmalloc_class(size);
+        if ((objp = kmem_cache_alloc(kmalloc_caches[i])) != NULL) {
+            local_intr_save(intr_flag);
+            kmalloc_bytes += kmalloc_class_size(i);
+            local_intr_restore(intr_flag);
+        }
+        return objp;
+    }
+
+    size_t n = ROUNDUP(size, PGSIZE) / PGSIZE;
+    struct Page *page;
+    if ((page = alloc_pages(n)) == NULL) {
+        return NULL;
+    }
+    page->property = n;
+    local_intr_save(intr_flag);
+    kmalloc_bytes += n * PGSIZE;
+    local_intr_restore(intr_flag);
+    return page2kva(page);
 }
 
-static void *__kmalloc(size_t size, gfp_t gfp)
-{
-	slob_t *m;
-	bigblock_t *bb;
-	unsigned long flags;
-
-	if (size < PAGE_SIZE - SLOB_UNIT) {
-		m = slob_alloc(size + SLOB_UNIT, gfp, 0);
-		return m ? (void *)(m + 1) : 0;
-	}
+void
+kfree(void *objp) {
+    if (objp == NULL) {
+        return;
+    }
+    size_t size;
+    if ((uintptr_t)objp % PGSIZE == 0) {
+        struct Page *page = kva2page(objp);
+        size = page->property * PGSIZE;
+        free_pages(page, page->property);
+    }
+    else {
+        struct kmem_cache *cachep = kmem_cache_of(objp);
+        size = cachep->objsize;
+        kmem_cache_free(cachep, objp);
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    kmalloc_bytes -= size;
+    local_intr_restore(intr_flag);
+}
 
-	bb = slob_alloc(sizeof(bigblock_t), gfp, 0);
-	if (!bb)
-		return 0;
+/* ------------------------------------------------------------------ */
 
-	bb->order = find_order(size);
-	bb->pages = (void *)__slob_get_free_pages(gfp, bb->order);
+static void
+check_kmalloc(void) {
+    size_t kmalloc_bytes_store = kallocated();
 
-	if (bb->pages) {
-		spin_lock_irqsave(&block_lock, flags);
-		bb->next = bigblocks;
-		bigblocks = bb;
-		spin_unlock_irqrestore(&block_lock, flags);
-		return bb->pages;
-	}
+    void *small = kmalloc(1), *mid = kmalloc(KMALLOC_MAX_SMALL), *large = kmalloc(KMALLOC_MAX_SMALL + 1);
+    assert(small != NULL && mid != NULL && large != NULL);
+    assert((uintptr_t)small % PGSIZE != 0 && (uintptr_t)mid % PGSIZE != 0 && (uintptr_t)large % PGSIZE == 0);
+    assert(kmem_cache_of(small) == kmalloc_caches[0] && kmem_cache_of(mid) == kmalloc_caches[KMALLOC_NCLASS - 1]);
+    assert(kallocated() == kmalloc_bytes_store + KMALLOC_MIN_SMALL + KMALLOC_MAX_SMALL + PGSIZE);
+    kfree(small), kfree(mid), kfree(large);
+    assert(kallocated() == kmalloc_bytes_store);
 
-	slob_free(bb, sizeof(bigblock_t));
-	return 0;
-}
-
-void *
-kmalloc(size_t size)
-{
-  return __kmalloc(size, 0);
+    cprintf("check_kmalloc() succeeded!\n");
 }
 
+/*
+ * the kmalloc/slob benchmark below, and slob itself, are only built with
+ * make "DEFS+=-DKMALLOC_BENCH"; init_main runs it then.
+ */
+#ifdef KMALLOC_BENCH
 
-void kfree(void *block)
-{
-	bigblock_t *bb, **last = &bigblocks;
-	unsigned long flags;
+#define CHECK_SLOTS                 256
+#define CHECK_ROUNDS                4000
+#define CHECK_LARGE_ONE_IN          32
 
-	if (!block)
-		return;
+static void *check_ptr[CHECK_SLOTS];
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		/* might be on the big block list */
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
-			if (bb->pages == block) {
-				*last = bb->next;
-				spin_unlock_irqrestore(&block_lock, flags);
-				__slob_free_pages((unsigned long)block, bb->order);
-				slob_free(bb, sizeof(bigblock_t));
-				return;
-			}
-		}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
+struct kmalloc_ops {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*free)(void *objp);
+};
 
-	slob_free((slob_t *)block - 1, 0);
-	return;
+static size_t
+check_random_size(void) {
+    unsigned int r = (unsigned int)rand();
+    if (r % CHECK_LARGE_ONE_IN == 0) {
+        return KMALLOC_MAX_SMALL + (r / CHECK_LARGE_ONE_IN) % (3 * PGSIZE);
+    }
+    return 1 + (r / CHECK_LARGE_ONE_IN) % ((r & 1) ? 128 : KMALLOC_MAX_SMALL);
 }
 
-
-unsigned int ksize(const void *block)
-{
-	bigblock_t *bb;
-	unsigned long flags;
-
-	if (!block)
-		return 0;
-
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; bb = bb->next)
-			if (bb->pages == block) {
-				spin_unlock_irqrestore(&slob_lock, flags);
-				return PAGE_SIZE << bb->order;
-			}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
-
-	return ((slob_t *)block - 1)->units * SLOB_UNIT;
+/*
+ * kmalloc_bench - the same random alloc/free sequence on @ops, with up to
+ *                 CHECK_SLOTS blocks alive. reports the time taken and the
+ *                 pages taken from pmm when the workload ends, against the
+ *                 bytes that were asked for by the blocks still alive.
+ */
+static void
+kmalloc_bench(struct kmalloc_ops *ops) {
+    size_t nr_free_pages_store = nr_free_pages(), live_bytes = 0;
+    srand(1);
+
+    int i, round;
+    uint64_t start = rdtime();
+    for (round = 0; round < CHECK_ROUNDS; round ++) {
+        i = (unsigned int)rand() % CHECK_SLOTS;
+        if (check_ptr[i] != NULL) {
+            ops->free(check_ptr[i]);
+            check_ptr[i] = NULL;
+        }
+        else {
+            size_t size = check_random_size();
+            assert((check_ptr[i] = ops->alloc(size)) != NULL);
+            *(size_t *)check_ptr[i] = size;
+        }
+    }
+    uint64_t cycles = rdtime() - start;
+
+    for (i = 0; i < CHECK_SLOTS; i ++) {
+        if (check_ptr[i] != NULL) {
+            live_bytes += *(size_t *)check_ptr[i];
+        }
+    }
+    size_t pages = nr_free_pages_store - nr_free_pages();
+    for (i = 0; i < CHECK_SLOTS; i ++) {
+        ops->free(check_ptr[i]);
+        check_ptr[i] = NULL;
+    }
+    cprintf("kmalloc bench %s: %d rounds in %d cycles, %d KB live in %d pages.\n",
+            ops->name, CHECK_ROUNDS, (int)cycles, live_bytes / 1024, pages);
 }
 
 
+/*
+ * check_kmalloc_bench - compare kmalloc with slob on the same workload. not run
+ *                       at boot: it takes a while, and slob keeps the arena pages
+ *                       it grew into, so they are never given back to pmm.
+ */
+void
+check_kmalloc_bench(void) {
+    size_t kmalloc_bytes_store = kallocated();
+    struct kmalloc_ops kmalloc_ops = {"kmalloc", kmalloc, kfree};
+    struct kmalloc_ops slob_ops = {"slob", slob_kmalloc, slob_kfree};
+    kmalloc_bench(&kmalloc_ops);
+    kmalloc_bench(&slob_ops);
+    assert(kallocated() == kmalloc_bytes_store);
+    cprintf("check_kmalloc_bench() succeeded!\n");
+}
 
+#endif /* KMALLOC_BENCH */
@@ -5,6 +5,10 @@
 
 #define KMALLOC_MAX_ORDER       10
 
+#define KMALLOC_MIN_SMALL       16          /* smallest size class */
+#define KMALLOC_MAX_SMALL       1024        /* largest size class, larger blocks take whole pages */
+#define KMALLOC_NCLASS          7           /* 16, 32, ..., 1024 */
+
 void kmalloc_init(void);
 
 void *kmalloc(size_t n);
@@ -13,4 +17,3 @@ void kfree(void *objp);
 size_t kallocated(void);
 
 #endif /* !__KERN_MM_KMALLOC_H__ */
-
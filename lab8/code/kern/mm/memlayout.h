@@ -94,11 +94,15 @@ typedef pte_t swap_entry_t; //the pte can also be a swap entry
  * */
 struct Page {
     int ref;                        // page frame's reference counter
+    int pinned;                     // # of kernel users accessing the page in place, not swapped out or reclaimed while > 0
     uint64_t flags;                 // array of flags that describe the status of the page frame
     unsigned int property;          // the num of free block, used in first fit pm manager
     list_entry_t page_link;         // free list link
     list_entry_t pra_page_link;     // used for pra (page replace algorithm)
     uintptr_t pra_vaddr;            // used for pra (page replace algorithm)
+    struct pcache *mapping;         // the page cache holding this page, NULL if none
+    uint32_t index;                 // index of this page in its page cache
+    list_entry_t pc_link;           // hash link in the page cache
 };
 
 /* Flags describing the status of a page frame */
@@ -111,6 +115,14 @@ struct Page {
 #define SetPageProperty(page)       set_bit(PG_property, &((page)->flags))
 #define ClearPageProperty(page)     clear_bit(PG_property, &((page)->flags))
 #define PageProperty(page)          test_bit(PG_property, &((page)->flags))
+#define PG_dirty                    2       // if this bit=1: the Page is a page cache page modified since it was last written back
+#define SetPageDirty(page)          set_bit(PG_dirty, &((page)->flags))
+#define ClearPageDirty(page)        clear_bit(PG_dirty, &((page)->flags))
+#define PageDirty(page)             test_bit(PG_dirty, &((page)->flags))
+#define PG_zeroed                   3       // if this bit=1: the Page is a free page in the zeroed page pool, its content is all zero
+#define SetPageZeroed(page)         set_bit(PG_zeroed, &((page)->flags))
+#define ClearPageZeroed(page)       clear_bit(PG_zeroed, &((page)->flags))
+#define PageZeroed(page)            test_bit(PG_zeroed, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
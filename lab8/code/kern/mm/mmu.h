@@ -79,6 +79,7 @@
 #define PTE_A     0x040 // Accessed
 #define PTE_D     0x080 // Dirty
 #define PTE_SOFT  0x300 // Reserved for Software
+#define PTE_COW   0x100 // (software) page shared after fork, copy it on the first write
 
 #define PAGE_TABLE_DIR (PTE_V)
 #define READ_ONLY (PTE_R | PTE_V)
@@ -89,4 +90,8 @@
 
 #define PTE_USER (PTE_R | PTE_W | PTE_X | PTE_U | PTE_V)
 
+// a valid level 0 page directory entry with any of these set is a leaf, mapping
+// a whole PTSIZE (2M) megapage itself instead of pointing to a page table
+#define PTE_LEAF (PTE_R | PTE_W | PTE_X)
+
 #endif /* !__KERN_MM_MMU_H__ */
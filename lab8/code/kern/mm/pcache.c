@@ -0,0 +1,144 @@
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <list.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <pcache.h>
+#include <assert.h>
+
+// hash of all cached pages, keyed by (mapping, index), linked by page->pc_link
+static list_entry_t pcache_hash[PCACHE_HASH_SIZE];
+// all cached pages, most recently used first, linked by page->pra_page_link
+static list_entry_t pcache_lru;
+
+#define pc_hashfn(pc, index)                        \
+    (hash32((uint32_t)((uintptr_t)(pc) >> 4) ^ (index), PCACHE_HASH_SHIFT))
+
+void
+pcache_init(void) {
+    int i;
+    for (i = 0; i < PCACHE_HASH_SIZE; i ++) {
+        list_init(pcache_hash + i);
+    }
+    list_init(&pcache_lru);
+}
+
+// pcache_init_mapping - init an empty page cache, e.g. for a newly loaded inode
+void
+pcache_init_mapping(struct pcache *pc) {
+    list_init(&(pc->page_list));
+    pc->nr_pages = pc->nr_dirty = 0;
+}
+
+/*
+ * pcache_lookup - find the page at @index of @pc, NULL if it isn't cached.
+ *                 the page is moved to the head of the lru list.
+ *                 NOTICE: no reference is taken for the caller.
+ */
+struct Page *
+pcache_lookup(struct pcache *pc, uint32_t index) {
+    list_entry_t *list = pcache_hash + pc_hashfn(pc, index), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct Page *page = le2page(le, pc_link);
+        if (page->mapping == pc && page->index == index) {
+            list_del(&(page->pra_page_link));
+            list_add(&pcache_lru, &(page->pra_page_link));
+            return page;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * pcache_insert - add a newly allocated, filled page to @pc at @index.
+ *                 the cache holds the first reference of the page.
+ */
+void
+pcache_insert(struct pcache *pc, uint32_t index, struct Page *page) {
+    assert(page_ref(page) == 0);
+    set_page_ref(page, 1);
+    page->mapping = pc, page->index = index;
+    ClearPageDirty(page);
+    list_add(&(pc->page_list), &(page->page_link));
+    list_add(pcache_hash + pc_hashfn(pc, index), &(page->pc_link));
+    list_add(&pcache_lru, &(page->pra_page_link));
+    pc->nr_pages ++;
+}
+
+/*
+ * pcache_remove - take @page out of its page cache and drop the cache's reference,
+ *                 the page is freed unless somebody else still holds it.
+ *                 NOTICE: dirty data is discarded, write it back first if needed.
+ */
+void
+pcache_remove(struct Page *page) {
+    struct pcache *pc = page->mapping;
+    assert(pc != NULL && pc->nr_pages > 0);
+    if (PageDirty(page)) {
+        ClearPageDirty(page);
+        pc->nr_dirty --;
+    }
+    list_del(&(page->page_link));
+    list_del(&(page->pc_link));
+    list_del(&(page->pra_page_link));
+    pc->nr_pages --;
+    page->mapping = NULL;
+    if (page_ref_dec(page) == 0) {
+        free_page(page);
+    }
+}
+
+void
+pcache_set_dirty(struct Page *page) {
+    assert(page->mapping != NULL);
+    if (!PageDirty(page)) {
+        SetPageDirty(page);
+        page->mapping->nr_dirty ++;
+    }
+}
+
+void
+pcache_clear_dirty(struct Page *page) {
+    assert(page->mapping != NULL);
+    if (PageDirty(page)) {
+        ClearPageDirty(page);
+        page->mapping->nr_dirty --;
+    }
+}
+
+/*
+ * pcache_truncate - drop all pages of @pc at or beyond @index,
+ *                   used when a file shrinks or is reclaimed (@index = 0).
+ */
+void
+pcache_truncate(struct pcache *pc, uint32_t index) {
+    list_entry_t *list = &(pc->page_list), *le = list_next(list);
+    while (le != list) {
+        struct Page *page = le2pcpage(le);
+        le = list_next(le);
+        if (page->index >= index) {
+            pcache_remove(page);
+        }
+    }
+}
+
+/*
+ * pcache_reclaim - free up to @n clean cached pages nobody else is using,
+ *                  least recently used first. called by the pmm when it runs out of memory.
+ *                  return the number of pages freed.
+ */
+size_t
+pcache_reclaim(size_t n) {
+    size_t freed = 0;
+    list_entry_t *le = list_prev(&pcache_lru);
+    while (freed < n && le != &pcache_lru) {
+        struct Page *page = le2page(le, pra_page_link);
+        le = list_prev(le);
+        if (page_ref(page) == 1 && !PageDirty(page) && !page_pinned(page)) {
+            pcache_remove(page);
+            freed ++;
+        }
+    }
+    return freed;
+}
@@ -0,0 +1,43 @@
+#ifndef __KERN_MM_PCACHE_H__
+#define __KERN_MM_PCACHE_H__
+
+#include <defs.h>
+#include <list.h>
+#include <memlayout.h>
+
+/*
+ * Page cache: whole pages of file data kept in memory, indexed by
+ * (owner pcache, page index in the file).
+ *
+ * A cached page holds one reference (page->ref) on behalf of the cache;
+ * anybody else using the page takes an extra one. Only pages with no
+ * other user and no unwritten data may be reclaimed when memory is short,
+ * writing dirty pages back is left to the owner (e.g. the file system's
+ * fsync), which knows where the page lives on disk.
+ *
+ * The kernel is not preemptive and none of these routines sleep, so the
+ * cache needs no lock of its own.
+ */
+
+#define PCACHE_HASH_SHIFT                   10
+#define PCACHE_HASH_SIZE                    (1 << PCACHE_HASH_SHIFT)
+
+struct pcache {
+    list_entry_t page_list;                 /* all pages of this cache, linked by page->page_link */
+    size_t nr_pages;                        /* # of pages in page_list */
+    size_t nr_dirty;                        /* # of PG_dirty pages in page_list */
+};
+
+#define le2pcpage(le)                       le2page(le, page_link)
+
+void pcache_init(void);
+void pcache_init_mapping(struct pcache *pc);
+struct Page *pcache_lookup(struct pcache *pc, uint32_t index);
+void pcache_insert(struct pcache *pc, uint32_t index, struct Page *page);
+void pcache_remove(struct Page *page);
+void pcache_set_dirty(struct Page *page);
+void pcache_clear_dirty(struct Page *page);
+void pcache_truncate(struct pcache *pc, uint32_t index);
+size_t pcache_reclaim(size_t n);
+
+#endif /* !__KERN_MM_PCACHE_H__ */
@@ -1,9 +1,12 @@
+#include <asid.h>
+#include <buddy_pmm.h>
 #include <default_pmm.h>
 #include <defs.h>
 #include <error.h>
 #include <kmalloc.h>
 #include <memlayout.h>
 #include <mmu.h>
+#include <pcache.h>
 #include <pmm.h>
 #include <sbi.h>
 #include <stdio.h>
@@ -34,9 +37,113 @@ static void check_alloc_page(void);
 static void check_pgdir(void);
 static void check_boot_pgdir(void);
 
+// the pmm_manager to use, pick another one with e.g. make "DEFS+=-DPMM_MANAGER=default_pmm_manager"
+#ifndef PMM_MANAGER
+#define PMM_MANAGER buddy_pmm_manager
+#endif
+
+/*
+ * page magazines: a cache of free single pages and free 2-page blocks (kernel stacks)
+ * in front of pmm_manager. alloc_pages/free_pages of these sizes take a block from/put
+ * a block on the head of the magazine, so the most recently freed (cache hot) block is
+ * used first; an empty magazine is refilled and an overfull one drained (from its cold
+ * tail) PMM_MAG_BATCH blocks at a time. blocks sitting in a magazine count as free.
+ */
+#define PMM_MAG_MAX_PAGES           2       // blocks of 1 .. PMM_MAG_MAX_PAGES pages are cached
+#define PMM_MAG_BATCH               16      // # of blocks moved by each refill/drain
+#define PMM_MAG_HIGH                64      // drain a magazine holding more blocks than this
+
+static struct page_magazine {
+    list_entry_t free_list;                 // the free blocks, hottest first
+    size_t count;                           // # of blocks in free_list
+} magazines[PMM_MAG_MAX_PAGES];
+
+static bool magazine_ok = 0;
+
+// magazine_refill - move up to PMM_MAG_BATCH free blocks of @n pages from pmm_manager to its magazine
+static void magazine_refill(size_t n) {
+    struct page_magazine *mag = magazines + n - 1;
+    int i;
+    for (i = 0; i < PMM_MAG_BATCH; i ++) {
+        struct Page *page;
+        if ((page = pmm_manager->alloc_pages(n)) == NULL) {
+            break;
+        }
+        list_add_before(&(mag->free_list), &(page->page_link));
+        mag->count ++;
+    }
+}
+
+// magazine_drain - give up to @nr_blocks of the coldest blocks of the @n pages magazine back to pmm_manager
+static size_t magazine_drain(size_t n, size_t nr_blocks) {
+    struct page_magazine *mag = magazines + n - 1;
+    size_t i;
+    for (i = 0; i < nr_blocks && mag->count != 0; i ++) {
+        list_entry_t *le = list_prev(&(mag->free_list));
+        list_del(le);
+        mag->count --;
+        pmm_manager->free_pages(le2page(le, page_link), n);
+    }
+    return i;
+}
+
+// magazine_drain_all - empty all magazines so that pmm_manager can merge their pages
+static size_t magazine_drain_all(void) {
+    size_t n, nr_pages = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        for (n = 1; n <= PMM_MAG_MAX_PAGES; n ++) {
+            nr_pages += magazine_drain(n, magazines[n - 1].count) * n;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return nr_pages;
+}
+
+/*
+ * zeroed page pool: free pages cleared by the idle thread (zero_page_idle) ahead of time,
+ * so that alloc_zeroed_page can hand out a page for anonymous memory, the BSS or a page
+ * table without clearing it in the faulting context. the pool is only filled while there
+ * is plenty of free memory, its pages count as free and are given back when memory runs out.
+ */
+#define PMM_ZERO_HIGH               64      // max # of pages in the pool
+#define PMM_ZERO_MIN_FREE           1024    // don't fill the pool below this many free pages
+
+static struct zero_pool {
+    list_entry_t free_list;                 // the zeroed pages, all with PG_zeroed set
+    size_t count;                           // # of pages in free_list
+    size_t hits, misses;                    // alloc_zeroed_page served from the pool or not
+} zero_pool;
+
+// zero_pool_drain - give all pages of the zeroed page pool back to pmm_manager
+static size_t zero_pool_drain(void) {
+    size_t nr_pages = 0;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *le;
+        while ((le = list_next(&(zero_pool.free_list))) != &(zero_pool.free_list)) {
+            list_del(le);
+            struct Page *page = le2page(le, page_link);
+            ClearPageZeroed(page);
+            pmm_manager->free_pages(page, 1);
+            nr_pages ++;
+        }
+        zero_pool.count = 0;
+    }
+    local_intr_restore(intr_flag);
+    return nr_pages;
+}
+
+// pmm_cache_drain - give all pages held by the magazines and the zeroed page pool back to pmm_manager
+size_t pmm_cache_drain(void) {
+    return magazine_drain_all() + zero_pool_drain();
+}
+
 // init_pmm_manager - initialize a pmm_manager instance
 static void init_pmm_manager(void) {
-    pmm_manager = &default_pmm_manager;
+    pmm_manager = &PMM_MANAGER;
     cprintf("memory management: %s\n", pmm_manager->name);
     pmm_manager->init();
 }
@@ -55,11 +162,33 @@ struct Page *alloc_pages(size_t n) {
     while (1) {
         local_intr_save(intr_flag);
         {
-            page = pmm_manager->alloc_pages(n);
+            if (magazine_ok && n <= PMM_MAG_MAX_PAGES) {
+                struct page_magazine *mag = magazines + n - 1;
+                if (mag->count == 0) {
+                    magazine_refill(n);
+                }
+                if (mag->count != 0) {
+                    list_entry_t *le = list_next(&(mag->free_list));
+                    list_del(le);
+                    mag->count --;
+                    page = le2page(le, page_link);
+                }
+            }
+            else {
+                page = pmm_manager->alloc_pages(n);
+            }
         }
         local_intr_restore(intr_flag);
 
-        if (page != NULL || n > 1 || swap_init_ok == 0) break;
+        if (page != NULL) break;
+
+        // the pages held in the magazines may merge into a block big enough
+        if (pmm_cache_drain() != 0) continue;
+
+        // clean page cache pages are the cheapest memory to give back
+        if (pcache_reclaim(n) != 0) continue;
+
+        if (n > 1 || swap_init_ok == 0) break;
 
         extern struct mm_struct *check_mm_struct;
         // cprintf("page %x, call swap_out in alloc_pages %d\n",page, n);
@@ -74,7 +203,22 @@ void free_pages(struct Page *base, size_t n) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        pmm_manager->free_pages(base, n);
+        if (magazine_ok && n <= PMM_MAG_MAX_PAGES) {
+            struct page_magazine *mag = magazines + n - 1;
+            struct Page *p = base;
+            for (; p != base + n; p ++) {
+                assert(!PageReserved(p) && !PageProperty(p));
+                p->flags = 0;
+                set_page_ref(p, 0);
+            }
+            list_add(&(mag->free_list), &(base->page_link));
+            if (++ mag->count > PMM_MAG_HIGH) {
+                magazine_drain(n, PMM_MAG_BATCH);
+            }
+        }
+        else {
+            pmm_manager->free_pages(base, n);
+        }
     }
     local_intr_restore(intr_flag);
 }
@@ -87,11 +231,146 @@ size_t nr_free_pages(void) {
     local_intr_save(intr_flag);
     {
         ret = pmm_manager->nr_free_pages();
+        size_t n;
+        for (n = 1; n <= PMM_MAG_MAX_PAGES; n ++) {
+            ret += magazines[n - 1].count * n;
+        }
+        ret += zero_pool.count;
     }
     local_intr_restore(intr_flag);
     return ret;
 }
 
+// alloc_zeroed_page - allocate a page whose content is all zero, from the zeroed page pool if possible
+struct Page *alloc_zeroed_page(void) {
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (zero_pool.count != 0) {
+            list_entry_t *le = list_next(&(zero_pool.free_list));
+            list_del(le);
+            zero_pool.count --, zero_pool.hits ++;
+            page = le2page(le, page_link);
+            ClearPageZeroed(page);
+        }
+        else {
+            zero_pool.misses ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+
+    if (page == NULL && (page = alloc_page()) != NULL) {
+        memset(page2kva(page), 0, PGSIZE);
+    }
+    return page;
+}
+
+/*
+ * zero_page_idle - clear one more free page into the zeroed page pool, called by the idle
+ *                  thread when it has nothing else to do. the page is cleared with interrupts
+ *                  enabled. return 0 if the pool is full or free memory is short.
+ */
+bool zero_page_idle(void) {
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        // a cold page from pmm_manager, the cache hot ones in the magazines are left alone
+        if (zero_pool.count < PMM_ZERO_HIGH && pmm_manager->nr_free_pages() > PMM_ZERO_MIN_FREE) {
+            page = pmm_manager->alloc_pages(1);
+        }
+    }
+    local_intr_restore(intr_flag);
+    if (page == NULL) {
+        return 0;
+    }
+
+    memset(page2kva(page), 0, PGSIZE);
+
+    local_intr_save(intr_flag);
+    {
+        SetPageZeroed(page);
+        list_add_before(&(zero_pool.free_list), &(page->page_link));
+        zero_pool.count ++;
+    }
+    local_intr_restore(intr_flag);
+    return 1;
+}
+
+// zero_pool_init - start the zeroed page pool, and check it
+static void zero_pool_init(void) {
+    list_init(&(zero_pool.free_list));
+    zero_pool.count = zero_pool.hits = zero_pool.misses = 0;
+
+    size_t nr_free_store = nr_free_pages();
+    struct Page *p0, *p1;
+    assert(zero_page_idle() && zero_pool.count == 1);
+    assert(nr_free_pages() == nr_free_store);
+    p0 = le2page(list_next(&(zero_pool.free_list)), page_link);
+    assert(PageZeroed(p0));
+
+    // a page from the pool is not cleared again, the one after it is
+    memset(page2kva(p0), 0x5a, PGSIZE);
+    assert(alloc_zeroed_page() == p0 && !PageZeroed(p0) && zero_pool.hits == 1);
+    assert((p1 = alloc_zeroed_page()) != NULL && zero_pool.misses == 1);
+    char *kva = page2kva(p1);
+    int i;
+    for (i = 0; i < PGSIZE; i ++) {
+        assert(kva[i] == 0);
+    }
+    free_page(p0);
+    free_page(p1);
+
+    while (zero_page_idle()) /* fill it */;
+    assert(zero_pool.count == PMM_ZERO_HIGH || nr_free_pages() <= PMM_ZERO_MIN_FREE + zero_pool.count);
+    assert(nr_free_pages() == nr_free_store);
+    zero_pool_drain();
+    assert(zero_pool.count == 0 && nr_free_pages() == nr_free_store);
+    zero_pool.hits = zero_pool.misses = 0;
+    cprintf("check_zero_pool() succeeded!\n");
+}
+
+// magazine_init - start caching free blocks in the magazines, and check them
+static void magazine_init(void) {
+    size_t n;
+    for (n = 1; n <= PMM_MAG_MAX_PAGES; n ++) {
+        list_init(&(magazines[n - 1].free_list));
+        magazines[n - 1].count = 0;
+    }
+    magazine_ok = 1;
+
+    size_t nr_free_store = nr_free_pages();
+    struct Page *p0, *p1;
+    assert((p0 = alloc_page()) != NULL && (p1 = alloc_pages(2)) != NULL);
+    assert(magazines[0].count == PMM_MAG_BATCH - 1 && magazines[1].count == PMM_MAG_BATCH - 1);
+    assert(nr_free_pages() == nr_free_store - 3);
+    // the block freed last is handed out first
+    free_page(p0);
+    free_pages(p1, 2);
+    assert(alloc_page() == p0 && alloc_pages(2) == p1);
+    free_page(p0);
+    free_pages(p1, 2);
+    assert(nr_free_pages() == nr_free_store);
+
+    // an overfull magazine goes back to pmm_manager in a batch
+    struct Page *check[PMM_MAG_HIGH + 1];
+    int i;
+    for (i = 0; i <= PMM_MAG_HIGH; i ++) {
+        assert((check[i] = alloc_page()) != NULL);
+    }
+    for (i = 0; i <= PMM_MAG_HIGH; i ++) {
+        free_page(check[i]);
+    }
+    assert(magazines[0].count <= PMM_MAG_HIGH);
+    assert(nr_free_pages() == nr_free_store);
+
+    magazine_drain_all();
+    assert(magazines[0].count == 0 && magazines[1].count == 0);
+    assert(nr_free_pages() == nr_free_store);
+    cprintf("check_magazine() succeeded!\n");
+}
+
 /* pmm_init - initialize the physical memory management */
 static void page_init(void) {
     extern char kern_entry[];
@@ -122,6 +401,7 @@ static void page_init(void) {
 
     for (size_t i = 0; i < npage - nbase; i++) {
         SetPageReserved(pages + i);
+        pages[i].pinned = 0;
     }
 
     uintptr_t freemem = PADDR((uintptr_t)pages + sizeof(struct Page) * (npage - nbase));
@@ -135,6 +415,7 @@ static void page_init(void) {
 }
 
 // boot_map_segment - setup&enable the paging mechanism
+//                  - every PTSIZE aligned part is mapped by a megapage, the rest by 4K pages
 // parameters
 //  la:   linear address of this memory need to map (after x86 segment map)
 //  size: memory size
@@ -146,10 +427,18 @@ static void boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size,
     size_t n = ROUNDUP(size + PGOFF(la), PGSIZE) / PGSIZE;
     la = ROUNDDOWN(la, PGSIZE);
     pa = ROUNDDOWN(pa, PGSIZE);
-    for (; n > 0; n--, la += PGSIZE, pa += PGSIZE) {
+    while (n > 0) {
+        if (perm != 0 && n >= NPTEENTRY && la % PTSIZE == 0 && pa % PTSIZE == 0) {
+            pde_t *pdep = get_pde(pgdir, la, 1);
+            assert(pdep != NULL && !(*pdep & PTE_V));
+            *pdep = pte_create(pa >> PGSHIFT, PTE_V | perm);
+            n -= NPTEENTRY, la += PTSIZE, pa += PTSIZE;
+            continue;
+        }
         pte_t *ptep = get_pte(pgdir, la, 1);
         assert(ptep != NULL);
         *ptep = pte_create(pa >> PGSHIFT, PTE_V | perm);
+        n --, la += PGSIZE, pa += PGSIZE;
     }
 }
 
@@ -243,9 +532,18 @@ void pmm_init(void) {
     // pmm
     check_alloc_page();
 
+    // from now on single pages and kernel stacks go through the magazines
+    magazine_init();
+
+    // the idle thread clears free pages ahead of time for alloc_zeroed_page
+    zero_pool_init();
+
     // switch from transient boot page directory to refined kernel page directory
     switch_kernel_memorylayout();
 
+    // processes run under ASIDs of their own from now on
+    asid_init();
+
     check_pgdir();
 
     static_assert(KERNBASE % PTSIZE == 0 && KERNTOP % PTSIZE == 0);
@@ -256,10 +554,49 @@ void pmm_init(void) {
 
 
     kmalloc_init();
+
+    pcache_init();
+}
+
+// get_pde - get the level 0 page directory entry for la, a megapage leaf or a pointer
+//         - to a page table, alloc the level 0 page directory if needed and @create
+pde_t *get_pde(pde_t *pgdir, uintptr_t la, bool create) {
+    pde_t *pdep1 = &pgdir[PDX1(la)];
+    if (!(*pdep1 & PTE_V)) {
+        struct Page *page;
+        if (!create || (page = alloc_zeroed_page()) == NULL) {
+            return NULL;
+        }
+        set_page_ref(page, 1);
+        *pdep1 = pte_create(page2ppn(page), PTE_U | PTE_V);
+    }
+    return &((pde_t *)KADDR(PDE_ADDR(*pdep1)))[PDX0(la)];
+}
+
+// megapage_split - replace the megapage mapped by *@pdep with a page table mapping the same
+//                - pages with the same permission. the pages of a user megapage already
+//                - hold one reference each for the mapping, which now belongs to their PTE.
+static pte_t *megapage_split(pde_t *pdep) {
+    struct Page *page;
+    if ((page = alloc_page()) == NULL) {
+        return NULL;
+    }
+    set_page_ref(page, 1);
+    pte_t *pt = page2kva(page);
+    uintptr_t ppn = PTE_ADDR(*pdep) >> PGSHIFT;
+    uint32_t perm = (*pdep & ((1 << PTE_PPN_SHIFT) - 1));
+    int i;
+    for (i = 0; i < NPTEENTRY; i ++) {
+        pt[i] = pte_create(ppn + i, perm);
+    }
+    *pdep = pte_create(page2ppn(page), PTE_U | PTE_V);
+    flush_tlb();
+    return pt;
 }
 
 // get_pte - get pte and return the kernel virtual address of this pte for la
 //        - if the PT contians this pte didn't exist, alloc a page for PT
+//        - la in a megapage has no pte: NULL, or with @create, split the megapage into 4K pages
 // parameter:
 //  pgdir:  the kernel virtual base address of PDT
 //  la:     the linear address need to map
@@ -293,34 +630,38 @@ pte_t *get_pte(pde_t *pgdir, uintptr_t la, bool create) {
      *   PTE_U           0x004                   // page table/directory entry
      * flags bit : User can access
      */
-    pde_t *pdep1 = &pgdir[PDX1(la)];
-    if (!(*pdep1 & PTE_V)) {
-        struct Page *page;
-        if (!create || (page = alloc_page()) == NULL) {
+    pde_t *pdep0 = get_pde(pgdir, la, create);
+    if (pdep0 == NULL) {
+        return NULL;
+    }
+    if (pde_is_megapage(*pdep0)) {
+        pte_t *pt;
+        if (!create || (pt = megapage_split(pdep0)) == NULL) {
             return NULL;
         }
-        set_page_ref(page, 1);
-        uintptr_t pa = page2pa(page);
-        memset(KADDR(pa), 0, PGSIZE);
-        *pdep1 = pte_create(page2ppn(page), PTE_U | PTE_V);
+        return &pt[PTX(la)];
     }
-
-    pde_t *pdep0 = &((pde_t *)KADDR(PDE_ADDR(*pdep1)))[PDX0(la)];
     if (!(*pdep0 & PTE_V)) {
         struct Page *page;
-        if (!create || (page = alloc_page()) == NULL) {
+        if (!create || (page = alloc_zeroed_page()) == NULL) {
             return NULL;
         }
         set_page_ref(page, 1);
-        uintptr_t pa = page2pa(page);
-        memset(KADDR(pa), 0, PGSIZE);
         *pdep0 = pte_create(page2ppn(page), PTE_U | PTE_V);
         }
     return &((pte_t *)KADDR(PDE_ADDR(*pdep0)))[PTX(la)];
 }
 
 // get_page - get related Page struct for linear address la using PDT pgdir
+//          - *ptep_store is NULL if la is in a megapage
 struct Page *get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store) {
+    pde_t *pdep = get_pde(pgdir, la, 0);
+    if (pdep != NULL && pde_is_megapage(*pdep)) {
+        if (ptep_store != NULL) {
+            *ptep_store = NULL;
+        }
+        return pte2page(*pdep) + PTX(la);
+    }
     pte_t *ptep = get_pte(pgdir, la, 0);
     if (ptep_store != NULL) {
         *ptep_store = ptep;
@@ -369,21 +710,217 @@ static inline void page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
     }
 }
 
+// megapages are turned off if pmm_manager hands out blocks which are not PTSIZE aligned
+static bool megapage_ok = 1;
+
+/*
+ * alloc_megapage - allocate a PTSIZE aligned block of NPTEENTRY pages for a megapage, NULL if
+ *                  there is none free. a megapage is only an optimization: nothing is reclaimed
+ *                  for it, the caller falls back to 4K pages.
+ */
+struct Page *alloc_megapage(void) {
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (megapage_ok && (page = pmm_manager->alloc_pages(NPTEENTRY)) != NULL &&
+            page2ppn(page) % NPTEENTRY != 0) {
+            // e.g. first fit, it can't be asked for an aligned block
+            pmm_manager->free_pages(page, NPTEENTRY);
+            page = NULL;
+            megapage_ok = 0;
+            cprintf("alloc_megapage: %s can't align megapages, turned off.\n", pmm_manager->name);
+        }
+    }
+    local_intr_restore(intr_flag);
+    return page;
+}
+
+// megapage_mappable - nothing but an empty page table is in the PTSIZE block at @la of pgdir
+bool megapage_mappable(pde_t *pgdir, uintptr_t la) {
+    pde_t *pdep = get_pde(pgdir, la, 0);
+    if (pdep == NULL || !(*pdep & PTE_V)) {
+        return 1;
+    }
+    if (pde_is_megapage(*pdep)) {
+        return 0;
+    }
+    pte_t *pt = KADDR(PDE_ADDR(*pdep));
+    int i;
+    for (i = 0; i < NPTEENTRY; i ++) {
+        if (pt[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * megapage_split_at - @la is an end of a range about to be unmapped, split the megapage it falls
+ *                     inside of (if any), so that unmap_range never has to. -E_NO_MEM if there
+ *                     is no page for the page table.
+ */
+int megapage_split_at(pde_t *pgdir, uintptr_t la) {
+    if (la % PTSIZE != 0) {
+        pde_t *pdep = get_pde(pgdir, la, 0);
+        if (pdep != NULL && pde_is_megapage(*pdep) && megapage_split(pdep) == NULL) {
+            return -E_NO_MEM;
+        }
+    }
+    return 0;
+}
+
+/*
+ * megapage_insert - map the PTSIZE aligned block of NPTEENTRY pages at @page (from alloc_megapage)
+ *                   as a megapage at @la. each of the pages takes one reference for the mapping.
+ *                   -E_INVAL if some of [la, la + PTSIZE) is mapped by 4K pages already.
+ */
+int megapage_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
+    assert(la % PTSIZE == 0 && page2ppn(page) % NPTEENTRY == 0 && (perm & PTE_LEAF));
+    if (!megapage_mappable(pgdir, la)) {
+        return -E_INVAL;
+    }
+    pde_t *pdep = get_pde(pgdir, la, 1);
+    if (pdep == NULL) {
+        return -E_NO_MEM;
+    }
+    if (*pdep & PTE_V) {
+        // an empty page table left behind can go
+        free_page(pde2page(*pdep));
+    }
+    int i;
+    for (i = 0; i < NPTEENTRY; i ++) {
+        page_ref_inc(page + i);
+    }
+    *pdep = pte_create(page2ppn(page), PTE_V | perm);
+    tlb_invalidate(pgdir, la);
+    return 0;
+}
+
+// megapage_remove - unmap the megapage *@pdep at @la, free its pages nobody else holds
+static void megapage_remove(pde_t *pgdir, uintptr_t la, pde_t *pdep) {
+    struct Page *page = pte2page(*pdep), *run = NULL;
+    *pdep = 0;
+    tlb_invalidate(pgdir, la);
+    // free the pages in runs, pinned pages stay until they are unpinned
+    int i;
+    for (i = 0; i < NPTEENTRY; i ++) {
+        if (page_ref_dec(page + i) == 0) {
+            if (run == NULL) {
+                run = page + i;
+            }
+            continue;
+        }
+        if (run != NULL) {
+            free_pages(run, page + i - run);
+            run = NULL;
+        }
+    }
+    if (run != NULL) {
+        free_pages(run, page + NPTEENTRY - run);
+    }
+}
+
+/*
+ * mmu_gather: unmap_range and exit_range clear the ptes (and free the page tables) of a
+ * range without fencing and freeing page by page. the pages whose last reference goes
+ * are gathered, the TLB is flushed once for the whole range, and only then the pages go
+ * back to the allocator, in runs of contiguous pages: until the flush a stale TLB entry
+ * may still reach them. a full batch is flushed and freed early.
+ */
+#define MMU_GATHER_BATCH            64      // # of pages gathered before they are flushed and freed
+#define TLB_RANGE_MAX_FENCES        32      // tlb_invalidate_range flushes the whole address space beyond this
+
+struct mmu_gather {
+    pde_t *pgdir;
+    uintptr_t start, end;                   // ptes were cleared in [start, end), none if start == end
+    bool freed_tables;                      // page tables were freed, the whole address space is flushed
+    size_t nr_pages;
+    struct Page *pages[MMU_GATHER_BATCH];   // pages to free after the flush
+};
+
+static void tlb_gather_init(struct mmu_gather *tlb, pde_t *pgdir) {
+    tlb->pgdir = pgdir;
+    tlb->start = tlb->end = 0;
+    tlb->freed_tables = 0;
+    tlb->nr_pages = 0;
+}
+
+// tlb_flush_gathered - flush the TLB for what @tlb has gathered, then free its pages
+static void tlb_flush_gathered(struct mmu_gather *tlb) {
+    if (tlb->freed_tables) {
+        tlb_invalidate_range(tlb->pgdir, USERBASE, USERTOP);
+    }
+    else if (tlb->start != tlb->end) {
+        tlb_invalidate_range(tlb->pgdir, tlb->start, tlb->end);
+    }
+    size_t i, j;
+    for (i = 0; i < tlb->nr_pages; i = j) {
+        for (j = i + 1; j < tlb->nr_pages && tlb->pages[j] == tlb->pages[j - 1] + 1; j ++) {
+            /* find the end of the run */ ;
+        }
+        free_pages(tlb->pages[i], j - i);
+    }
+    tlb_gather_init(tlb, tlb->pgdir);
+}
+
+static void tlb_gather_page(struct mmu_gather *tlb, struct Page *page) {
+    tlb->pages[tlb->nr_pages ++] = page;
+    if (tlb->nr_pages == MMU_GATHER_BATCH) {
+        tlb_flush_gathered(tlb);
+    }
+}
+
+// tlb_remove_pte - like page_remove_pte, the TLB flush and the free wait for tlb_flush_gathered
+static void tlb_remove_pte(struct mmu_gather *tlb, uintptr_t la, pte_t *ptep) {
+    if (*ptep & PTE_V) {
+        struct Page *page = pte2page(*ptep);
+        *ptep = 0;
+        if (tlb->start == tlb->end) {
+            tlb->start = la;
+        }
+        tlb->end = la + PGSIZE;
+        if (page_ref_dec(page) == 0) {
+            tlb_gather_page(tlb, page);
+        }
+    }
+}
+
+// tlb_free_table - free the page table (or level 0 page directory) @page after the flush
+static void tlb_free_table(struct mmu_gather *tlb, struct Page *page) {
+    tlb->freed_tables = 1;
+    tlb_gather_page(tlb, page);
+}
+
 void unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     assert(start % PGSIZE == 0 && end % PGSIZE == 0);
     assert(USER_ACCESS(start, end));
 
+    struct mmu_gather tlb;
+    tlb_gather_init(&tlb, pgdir);
     do {
+        pde_t *pdep = get_pde(pgdir, start, 0);
+        if (pdep != NULL && pde_is_megapage(*pdep)) {
+            if (start % PTSIZE == 0 && end - start >= PTSIZE) {
+                megapage_remove(pgdir, start, pdep);
+                start += PTSIZE;
+                continue;
+            }
+            // only a part of the megapage goes: mm_unmap splits such megapages before it
+            // changes anything (megapage_split_at), and a megapage never crosses a vma
+            panic("unmap_range: megapage at %x unmapped in part.\n", start);
+        }
         pte_t *ptep = get_pte(pgdir, start, 0);
         if (ptep == NULL) {
             start = ROUNDDOWN(start + PTSIZE, PTSIZE);
             continue;
         }
         if (*ptep != 0) {
-            page_remove_pte(pgdir, start, ptep);
+            tlb_remove_pte(&tlb, start, ptep);
         }
         start += PGSIZE;
     } while (start != 0 && start < end);
+    tlb_flush_gathered(&tlb);
 }
 
 void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
@@ -393,6 +930,8 @@ void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     uintptr_t d1start, d0start;
     int free_pt, free_pd0;
     pde_t *pd0, *pt, pde1, pde0;
+    struct mmu_gather tlb;
+    tlb_gather_init(&tlb, pgdir);
     d1start = ROUNDDOWN(start, PDSIZE);
     d0start = ROUNDDOWN(start, PTSIZE);
     do {
@@ -406,10 +945,9 @@ void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
         if (pde1&PTE_V){
             pd0 = page2kva(pde2page(pde1));
             // try to free all page tables
-            free_pd0 = 1;
             do {
                 pde0 = pd0[PDX0(d0start)];
-                if (pde0&PTE_V) {
+                if ((pde0&PTE_V) && !pde_is_megapage(pde0)) {
                     pt = page2kva(pde2page(pde0));
                     // try to free page table
                     free_pt = 1;
@@ -420,29 +958,37 @@ void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
                         }
                     // free it only when all entry are already invalid
                     if (free_pt) {
-                        free_page(pde2page(pde0));
+                        tlb_free_table(&tlb, pde2page(pde0));
                         pd0[PDX0(d0start)] = 0;
                     }
-                } else
-                    free_pd0 = 0;
+                }
                 d0start += PTSIZE;
             } while (d0start != 0 && d0start < d1start+PDSIZE && d0start < end);
-            // free level 0 page directory only when all pde0s in it are already invalid
+            // free level 0 page directory only when all pde0s in it are invalid now,
+            // [start, end) may cover only a part of it (e.g. munmap)
+            free_pd0 = 1;
+            for (int i = 0;i <NPDEENTRY;i++)
+                if (pd0[i]&PTE_V){
+                    free_pd0 = 0;
+                    break;
+                }
             if (free_pd0) {
-                free_page(pde2page(pde1));
+                tlb_free_table(&tlb, pde2page(pde1));
                 pgdir[PDX1(d1start)] = 0;
             }
         }
         d1start += PDSIZE;
         d0start = d1start;
     } while (d1start != 0 && d1start < end);
+    tlb_flush_gathered(&tlb);
 }
 /* copy_range - copy content of memory (start, end) of one process A to another
  * process B
  * @to:    the addr of process B's Page Directory
  * @from:  the addr of process A's Page Directory
- * @share: flags to indicate to dup OR share. We just use dup method, so it
- * didn't be used.
+ * @share: flags to indicate to dup OR share. dup copies every page now; share
+ *         maps A's pages into B as well (refcounted), writable pages become
+ *         read-only PTE_COW in both and are copied by do_pgfault on the first write.
  *
  * CALL GRAPH: copy_mm-->dup_mmap-->copy_range
  */
@@ -452,6 +998,24 @@ int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end,
     assert(USER_ACCESS(start, end));
     // copy content by page unit.
     do {
+        pde_t *pdep = get_pde(from, start, 0);
+        if (pdep != NULL && pde_is_megapage(*pdep)) {
+            // megapages are never shared, B gets a copy of its own. if there is no
+            // megapage for it, A's megapage is split and its 4K pages go the usual way
+            assert(start % PTSIZE == 0 && end - start >= PTSIZE);
+            struct Page *npage = alloc_megapage();
+            if (npage != NULL) {
+                memcpy(page2kva(npage), page2kva(pte2page(*pdep)), PTSIZE);
+                if (megapage_insert(to, npage, start, (*pdep & PTE_USER)) == 0) {
+                    start += PTSIZE;
+                    continue;
+                }
+                free_pages(npage, NPTEENTRY);
+            }
+            if (megapage_split(pdep) == NULL) {
+                return -E_NO_MEM;
+            }
+        }
         // call get_pte to find process A's pte according to the addr start
         pte_t *ptep = get_pte(from, start, 0), *nptep;
         if (ptep == NULL) {
@@ -467,11 +1031,25 @@ int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end,
             uint32_t perm = (*ptep & PTE_USER);
             // get page from ptep
             struct Page *page = pte2page(*ptep);
-            // alloc a page for process B
-            struct Page *npage = alloc_page();
             assert(page != NULL);
-            assert(npage != NULL);
             int ret = 0;
+            if (share) {
+                // share the page, a writable one turns read-only copy-on-write in A and B
+                if (*ptep & PTE_W) {
+                    *ptep = (*ptep & ~PTE_W) | PTE_COW;
+                    tlb_invalidate(from, start);
+                }
+                perm = (*ptep & (PTE_USER | PTE_COW));
+                ret = page_insert(to, page, start, perm);
+                assert(ret == 0);
+                start += PGSIZE;
+                continue;
+            }
+            // alloc a page for process B
+            struct Page *npage = alloc_page();
+            if (npage == NULL) {
+                return -E_NO_MEM;
+            }
             /* LAB5:EXERCISE2 YOUR CODE
              * replicate content of page to npage, build the map of phy addr of
              * nage with the linear addr start
@@ -493,6 +1071,10 @@ int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end,
             void * kva_src = page2kva(page);
             void * kva_dst = page2kva(npage);
             memcpy(kva_dst, kva_src, PGSIZE);
+            if (*ptep & PTE_COW) {
+                // B gets its own copy, nothing is shared with it any more
+                perm = (perm | PTE_W) & ~PTE_COW;
+            }
             ret = page_insert(to, npage, start, perm);
             assert(ret == 0);
         }
@@ -504,7 +1086,9 @@ int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end,
 // page_remove - free an Page which is related linear address la and has an
 // validated pte
 void page_remove(pde_t *pgdir, uintptr_t la) {
-    pte_t *ptep = get_pte(pgdir, la, 0);
+    // a page of a megapage is removed alone after splitting it
+    pde_t *pdep = get_pde(pgdir, la, 0);
+    pte_t *ptep = get_pte(pgdir, la, pdep != NULL && pde_is_megapage(*pdep));
     if (ptep != NULL) {
         page_remove_pte(pgdir, la, ptep);
     }
@@ -539,15 +1123,48 @@ int page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
 
 // invalidate a TLB entry, but only if the page tables being
 // edited are the ones currently in use by the processor.
+// tlb_asid - the ASID of pgdir if it is the running page table, -1 otherwise
+static long tlb_asid(pde_t *pgdir) {
+    uintptr_t satp = read_csr(satp);
+    if ((satp & SATP64_PPN) == (PADDR(pgdir) >> PGSHIFT)) {
+        return (satp & SATP64_ASID) >> SATP64_ASID_SHIFT;
+    }
+    return -1;
+}
+
 void tlb_invalidate(pde_t *pgdir, uintptr_t la) {
-    asm volatile("sfence.vma %0" : : "r"(la));
+    long asid = tlb_asid(pgdir);
+    if (asid >= 0) {
+        // only the running ASID can have an entry of pgdir, the others are from older generations
+        asm volatile("sfence.vma %0, %1" : : "r"(la), "r"(asid));
+    }
+    else {
+        // pgdir may be cached under its ASID, which is not known here
+        asm volatile("sfence.vma %0" : : "r"(la));
+    }
 }
 
-// pgdir_alloc_page - call alloc_page & page_insert functions to
-//                  - allocate a page size memory & setup an addr map
-//                  - pa<->la with linear address la and the PDT pgdir
-struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
-    struct Page *page = alloc_page();
+// tlb_invalidate_range - invalidate the TLB entries of [start, end) of pgdir, a large range
+//                      - is cheaper to flush with one fence for the whole address space
+void tlb_invalidate_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
+    if ((end - start) / PGSIZE > TLB_RANGE_MAX_FENCES) {
+        long asid = tlb_asid(pgdir);
+        if (asid >= 0) {
+            asm volatile("sfence.vma zero, %0" : : "r"(asid));
+        }
+        else {
+            flush_tlb();
+        }
+        return;
+    }
+    for (; start < end; start += PGSIZE) {
+        tlb_invalidate(pgdir, start);
+    }
+}
+
+// __pgdir_alloc_page - allocate a page (cleared if @zeroed) and map it at la of pgdir
+static struct Page *__pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm, bool zeroed) {
+    struct Page *page = (zeroed) ? alloc_zeroed_page() : alloc_page();
     if (page != NULL) {
         if (page_insert(pgdir, page, la, perm) != 0) {
             free_page(page);
@@ -575,6 +1192,18 @@ struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
     return page;
 }
 
+// pgdir_alloc_page - call alloc_page & page_insert functions to
+//                  - allocate a page size memory & setup an addr map
+//                  - pa<->la with linear address la and the PDT pgdir
+struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
+    return __pgdir_alloc_page(pgdir, la, perm, 0);
+}
+
+// pgdir_alloc_zeroed_page - like pgdir_alloc_page, the new page reads as zero
+struct Page *pgdir_alloc_zeroed_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
+    return __pgdir_alloc_page(pgdir, la, perm, 1);
+}
+
 static void check_alloc_page(void) {
     pmm_manager->check();
     cprintf("check_alloc_page() succeeded!\n");
@@ -648,10 +1277,24 @@ static void check_boot_pgdir(void) {
 
     nr_free_store=nr_free_pages();
 
-    for (i = ROUNDDOWN(KERNBASE, PGSIZE); i < npage * PGSIZE; i += PGSIZE) {
-        assert((ptep = get_pte(boot_pgdir, (uintptr_t)KADDR(i), 0)) != NULL);
-        assert(PTE_ADDR(*ptep) == i);
+    // the kernel map: megapages wherever it is PTSIZE aligned, 4K pages elsewhere
+    size_t nr_megapages = 0;
+    uintptr_t pa;
+    for (pa = KERNEL_BEGIN_PADDR; pa < npage * PGSIZE; pa += PGSIZE) {
+        uintptr_t la = (uintptr_t)KADDR(pa);
+        pde_t *pdep = get_pde(boot_pgdir, la, 0);
+        assert(pdep != NULL && (*pdep & PTE_V));
+        if (pde_is_megapage(*pdep)) {
+            assert(PTE_ADDR(*pdep) + la % PTSIZE == pa);
+            nr_megapages += (la % PTSIZE == 0);
+        }
+        else {
+            assert((ptep = get_pte(boot_pgdir, la, 0)) != NULL);
+            assert(PTE_ADDR(*ptep) == pa);
+        }
     }
+    assert(nr_megapages != 0);
+    cprintf("kernel map: %d megapages.\n", nr_megapages);
 
 
     assert(boot_pgdir[0] == 0);
@@ -32,18 +32,29 @@ void pmm_init(void);
 struct Page *alloc_pages(size_t n);
 void free_pages(struct Page *base, size_t n);
 size_t nr_free_pages(void);
+size_t pmm_cache_drain(void);
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
 
+struct Page *alloc_zeroed_page(void);
+bool zero_page_idle(void);
+
+pde_t *get_pde(pde_t *pgdir, uintptr_t la, bool create);
 pte_t *get_pte(pde_t *pgdir, uintptr_t la, bool create);
+struct Page *alloc_megapage(void);
+bool megapage_mappable(pde_t *pgdir, uintptr_t la);
+int megapage_split_at(pde_t *pgdir, uintptr_t la);
+int megapage_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm);
 struct Page *get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store);
 void page_remove(pde_t *pgdir, uintptr_t la);
 int page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm);
 
 void load_esp0(uintptr_t esp0);
 void tlb_invalidate(pde_t *pgdir, uintptr_t la);
+void tlb_invalidate_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
+struct Page *pgdir_alloc_zeroed_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
 void unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share);
@@ -145,6 +156,28 @@ page_ref_dec(struct Page *page) {
     return page->ref;
 }
 
+static inline void
+page_pin(struct Page *page) {
+    page->pinned += 1;
+}
+
+static inline void
+page_unpin(struct Page *page) {
+    assert(page->pinned > 0);
+    page->pinned -= 1;
+}
+
+static inline bool
+page_pinned(struct Page *page) {
+    return page->pinned != 0;
+}
+
+// pde_is_megapage - @pde (of a level 0 page directory) maps a megapage
+static inline bool
+pde_is_megapage(pde_t pde) {
+    return (pde & PTE_V) && (pde & PTE_LEAF);
+}
+
 static inline void flush_tlb() {
   asm volatile("sfence.vma");
 }
@@ -0,0 +1,314 @@
+#include <defs.h>
+#include <list.h>
+#include <string.h>
+#include <stdio.h>
+#include <sync.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <slab.h>
+#include <assert.h>
+
+/*
+ * struct slab - header at the start of every slab page. the header is followed by
+ * bufctl[num], bufctl[i] is the index of the free object after object i, or -1.
+ */
+struct slab {
+    list_entry_t slab_link;                         // entry in one of the slab lists of the cache
+    struct kmem_cache *cachep;                      // the cache this slab belongs to
+    size_t inuse;                                   // # of objects in use
+    int free;                                       // index of the first free object, -1 if none
+};
+
+#define le2slab(le, member)                         \
+    to_struct((le), struct slab, member)
+
+#define le2cache(le, member)                        \
+    to_struct((le), struct kmem_cache, member)
+
+#define slab_bufctl(slab)                           ((int *)((slab) + 1))
+#define slab_obj(cachep, slab, i)                   ((void *)(slab) + (cachep)->offset + (i) * (cachep)->objsize)
+
+static list_entry_t cache_list;
+
+// the cache the struct kmem_cache of all other caches come from
+static struct kmem_cache cache_cache;
+
+static inline size_t
+slab_offset(size_t num) {
+    return ROUNDUP(sizeof(struct slab) + num * sizeof(int), KMEM_ALIGN);
+}
+
+// kmem_cache_num - # of objects of @objsize bytes fitting in a slab
+static size_t
+kmem_cache_num(size_t objsize) {
+    size_t num = (PGSIZE - sizeof(struct slab)) / (objsize + sizeof(int));
+    while (num != 0 && slab_offset(num) + num * objsize > PGSIZE) {
+        num --;
+    }
+    return num;
+}
+
+// kmem_cache_setup - init @cachep as an empty cache and add it to the list of all caches
+static void
+kmem_cache_setup(struct kmem_cache *cachep, const char *name, size_t objsize, void (*ctor)(void *objp)) {
+    size_t num = kmem_cache_num(objsize);
+    memset(cachep, 0, sizeof(struct kmem_cache));
+    strncpy(cachep->name, name, KMEM_CACHE_NAMELEN);
+    cachep->objsize = objsize, cachep->num = num, cachep->offset = slab_offset(num);
+    cachep->ctor = ctor;
+    list_init(&(cachep->slabs_full));
+    list_init(&(cachep->slabs_partial));
+    list_init(&(cachep->slabs_free));
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_add(&cache_list, &(cachep->cache_link));
+    }
+    local_intr_restore(intr_flag);
+}
+
+/*
+ * kmem_cache_create - create a cache of objects of @size bytes, NULL if out of memory
+ *                     or if not even one object fits in a page.
+ * @ctor: if not NULL, called on every object once, when its slab is created
+ */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, void (*ctor)(void *objp)) {
+    size_t objsize = ROUNDUP((size == 0) ? 1 : size, KMEM_ALIGN);
+    if (kmem_cache_num(objsize) == 0) {
+        return NULL;
+    }
+
+    struct kmem_cache *cachep;
+    if ((cachep = kmem_cache_alloc(&cache_cache)) == NULL) {
+        return NULL;
+    }
+    kmem_cache_setup(cachep, name, objsize, ctor);
+    return cachep;
+}
+
+/*
+ * kmem_cache_destroy - free a cache and all its slabs, no object may be in use.
+ */
+void
+kmem_cache_destroy(struct kmem_cache *cachep) {
+    assert(cachep->nr_active == 0);
+    assert(list_empty(&(cachep->slabs_full)) && list_empty(&(cachep->slabs_partial)));
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_del(&(cachep->cache_link));
+    }
+    local_intr_restore(intr_flag);
+
+    list_entry_t *le;
+    while ((le = list_next(&(cachep->slabs_free))) != &(cachep->slabs_free)) {
+        list_del(le);
+        free_page(kva2page(le2slab(le, slab_link)));
+    }
+    kmem_cache_free(&cache_cache, cachep);
+}
+
+/*
+ * kmem_cache_grow - get a new slab for @cachep and construct its objects.
+ *                   called without the interrupts disabled, the slab is
+ *                   linked into the cache by the caller.
+ */
+static struct slab *
+kmem_cache_grow(struct kmem_cache *cachep) {
+    struct Page *page;
+    if ((page = alloc_page()) == NULL) {
+        return NULL;
+    }
+    struct slab *slab = page2kva(page);
+    slab->cachep = cachep;
+    slab->inuse = 0;
+    slab->free = 0;
+
+    int *bufctl = slab_bufctl(slab);
+    size_t i;
+    for (i = 0; i < cachep->num; i ++) {
+        bufctl[i] = i + 1;
+        if (cachep->ctor != NULL) {
+            cachep->ctor(slab_obj(cachep, slab, i));
+        }
+    }
+    bufctl[cachep->num - 1] = -1;
+    return slab;
+}
+
+/*
+ * kmem_cache_alloc - take an object from @cachep, NULL if out of memory.
+ *                    objects come from partial slabs first, then from free ones.
+ */
+void *
+kmem_cache_alloc(struct kmem_cache *cachep) {
+    struct slab *slab, *new_slab = NULL;
+    void *objp;
+    bool intr_flag;
+
+    local_intr_save(intr_flag);
+    while (list_empty(&(cachep->slabs_partial))) {
+        if (!list_empty(&(cachep->slabs_free))) {
+            list_entry_t *le = list_next(&(cachep->slabs_free));
+            list_del(le);
+            list_add(&(cachep->slabs_partial), le);
+            cachep->nr_free_slabs --;
+            break;
+        }
+        if (new_slab != NULL) {
+            list_add(&(cachep->slabs_partial), &(new_slab->slab_link));
+            cachep->nr_slabs ++, cachep->stat.grows ++;
+            new_slab = NULL;
+            break;
+        }
+        local_intr_restore(intr_flag);
+        if ((new_slab = kmem_cache_grow(cachep)) == NULL) {
+            return NULL;
+        }
+        local_intr_save(intr_flag);
+    }
+
+    slab = le2slab(list_next(&(cachep->slabs_partial)), slab_link);
+    assert(slab->free >= 0 && slab->inuse < cachep->num);
+    objp = slab_obj(cachep, slab, slab->free);
+    slab->free = slab_bufctl(slab)[slab->free];
+    if (++ slab->inuse == cachep->num) {
+        list_del(&(slab->slab_link));
+        list_add(&(cachep->slabs_full), &(slab->slab_link));
+    }
+    cachep->nr_active ++, cachep->stat.allocs ++;
+    local_intr_restore(intr_flag);
+
+    if (new_slab != NULL) {
+        // someone else refilled the cache while we were allocating the page
+        free_page(kva2page(new_slab));
+    }
+    return objp;
+}
+
+/*
+ * kmem_cache_free - give @objp back to @cachep, @objp may be NULL.
+ *                   empty slabs beyond KMEM_CACHE_FREE_SLABS are given back to pmm.
+ */
+void
+kmem_cache_free(struct kmem_cache *cachep, void *objp) {
+    if (objp == NULL) {
+        return;
+    }
+    struct slab *slab = ROUNDDOWN(objp, PGSIZE), *empty_slab = NULL;
+    assert(slab->cachep == cachep);
+    int i = (objp - slab_obj(cachep, slab, 0)) / cachep->objsize;
+    assert(i >= 0 && i < (int)cachep->num && objp == slab_obj(cachep, slab, i));
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(slab->inuse > 0);
+        slab_bufctl(slab)[i] = slab->free;
+        slab->free = i;
+        list_del(&(slab->slab_link));
+        if (-- slab->inuse != 0) {
+            list_add(&(cachep->slabs_partial), &(slab->slab_link));
+        }
+        else if (cachep->nr_free_slabs < KMEM_CACHE_FREE_SLABS) {
+            list_add(&(cachep->slabs_free), &(slab->slab_link));
+            cachep->nr_free_slabs ++;
+        }
+        else {
+            cachep->nr_slabs --, cachep->stat.shrinks ++;
+            empty_slab = slab;
+        }
+        cachep->nr_active --, cachep->stat.frees ++;
+    }
+    local_intr_restore(intr_flag);
+
+    if (empty_slab != NULL) {
+        free_page(kva2page(empty_slab));
+    }
+}
+
+/* kmem_cache_of - the cache @objp was allocated from */
+struct kmem_cache *
+kmem_cache_of(void *objp) {
+    struct slab *slab = ROUNDDOWN(objp, PGSIZE);
+    return slab->cachep;
+}
+
+void
+kmem_cache_print_stat(void) {
+    list_entry_t *le = &cache_list;
+    while ((le = list_next(le)) != &cache_list) {
+        struct kmem_cache *cachep = le2cache(le, cache_link);
+        cprintf("kmem_cache %s: objsize %d, %d/%d objects in %d slabs, allocs %d, frees %d, grows %d, shrinks %d.\n",
+                cachep->name, cachep->objsize, cachep->nr_active, cachep->nr_slabs * cachep->num, cachep->nr_slabs,
+                cachep->stat.allocs, cachep->stat.frees, cachep->stat.grows, cachep->stat.shrinks);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
+#define CHECK_OBJSIZE               100
+#define CHECK_NOBJS                 200
+
+static void
+check_ctor(void *objp) {
+    memset(objp, 0x5a, CHECK_OBJSIZE);
+}
+
+void
+check_slab(void) {
+    struct kmem_cache *cachep = kmem_cache_create("check", CHECK_OBJSIZE, check_ctor);
+    assert(cachep != NULL && cachep->objsize >= CHECK_OBJSIZE && cachep->num > 1);
+    assert(cachep->offset + cachep->num * cachep->objsize <= PGSIZE);
+
+    void **objs = kmalloc(sizeof(void *) * CHECK_NOBJS);
+    assert(objs != NULL);
+
+    // the cache has no slab yet, every page it takes is counted from here
+    size_t nr_free_pages_store = nr_free_pages();
+
+    int i, j;
+    for (i = 0; i < CHECK_NOBJS; i ++) {
+        assert((objs[i] = kmem_cache_alloc(cachep)) != NULL);
+        assert(((uintptr_t)objs[i]) % KMEM_ALIGN == 0);
+        for (j = 0; j < CHECK_OBJSIZE; j ++) {
+            assert(((unsigned char *)objs[i])[j] == 0x5a);
+        }
+        for (j = 0; j < i; j ++) {
+            assert(objs[i] + CHECK_OBJSIZE <= objs[j] || objs[j] + CHECK_OBJSIZE <= objs[i]);
+        }
+    }
+    size_t nr_slabs = ROUNDUP_DIV(CHECK_NOBJS, cachep->num);
+    assert(cachep->nr_active == CHECK_NOBJS && cachep->nr_slabs == nr_slabs);
+    assert(nr_free_pages() == nr_free_pages_store - nr_slabs);
+
+    // the last freed object is the first one handed out again
+    kmem_cache_free(cachep, objs[7]);
+    assert(kmem_cache_alloc(cachep) == objs[7]);
+
+    for (i = 0; i < CHECK_NOBJS; i ++) {
+        kmem_cache_free(cachep, objs[i]);
+    }
+    assert(cachep->nr_active == 0 && cachep->nr_slabs == KMEM_CACHE_FREE_SLABS);
+    assert(cachep->stat.allocs == CHECK_NOBJS + 1 && cachep->stat.frees == CHECK_NOBJS + 1);
+    assert(cachep->stat.grows == nr_slabs && cachep->stat.shrinks == nr_slabs - KMEM_CACHE_FREE_SLABS);
+
+    // the empty slab kept by the cache is used again
+    assert((objs[0] = kmem_cache_alloc(cachep)) != NULL);
+    assert(cachep->stat.grows == nr_slabs);
+    kmem_cache_free(cachep, objs[0]);
+
+    kmem_cache_destroy(cachep);
+    assert(nr_free_pages() == nr_free_pages_store);
+    kfree(objs);
+
+    cprintf("check_slab() succeeded!\n");
+}
+
+void
+kmem_cache_init(void) {
+    list_init(&cache_list);
+    kmem_cache_setup(&cache_cache, "kmem_cache", ROUNDUP(sizeof(struct kmem_cache), KMEM_ALIGN), NULL);
+}
@@ -0,0 +1,58 @@
+#ifndef __KERN_MM_SLAB_H__
+#define __KERN_MM_SLAB_H__
+
+#include <defs.h>
+#include <list.h>
+
+/*
+ * Slab object caches, for kernel structures allocated and freed all the time.
+ *
+ * A cache hands out objects of one size. It gets its memory one page (a slab)
+ * at a time; each slab starts with a struct slab header and an index array of
+ * its free objects, followed by the objects. Slabs are kept on three lists of
+ * the cache: full, partial (objects are taken from here first) and free. An
+ * object is freed back to the slab found by rounding its address down to the
+ * page, so alloc and free take constant time instead of walking a free list.
+ *
+ * The optional constructor runs once on each object when its slab is created,
+ * not on every alloc: objects must be freed back in their constructed state.
+ */
+
+#define KMEM_CACHE_NAMELEN              15
+#define KMEM_ALIGN                      sizeof(uintptr_t)   /* alignment of objects */
+#define KMEM_CACHE_FREE_SLABS           1                   /* # of empty slabs a cache keeps */
+
+/* counters of a cache, reported by kmem_cache_print_stat */
+struct kmem_cache_stat {
+    size_t allocs;                                  /* objects handed out */
+    size_t frees;                                   /* objects given back */
+    size_t grows;                                   /* slabs allocated */
+    size_t shrinks;                                 /* empty slabs given back to pmm */
+};
+
+struct kmem_cache {
+    char name[KMEM_CACHE_NAMELEN + 1];              /* name of the cache, for the statistics */
+    size_t objsize;                                 /* size of an object, aligned to KMEM_ALIGN */
+    size_t num;                                     /* # of objects per slab */
+    size_t offset;                                  /* offset of the first object in a slab */
+    void (*ctor)(void *objp);                       /* constructor of new objects, may be NULL */
+    list_entry_t slabs_full;                        /* slabs with all objects in use */
+    list_entry_t slabs_partial;                     /* slabs with some objects in use */
+    list_entry_t slabs_free;                        /* slabs with no object in use */
+    size_t nr_slabs;                                /* # of slabs on the three lists */
+    size_t nr_free_slabs;                           /* # of slabs on slabs_free */
+    size_t nr_active;                               /* # of objects in use */
+    struct kmem_cache_stat stat;
+    list_entry_t cache_link;                        /* entry in the list of all caches */
+};
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, void (*ctor)(void *objp));
+void kmem_cache_destroy(struct kmem_cache *cachep);
+void *kmem_cache_alloc(struct kmem_cache *cachep);
+void kmem_cache_free(struct kmem_cache *cachep, void *objp);
+struct kmem_cache *kmem_cache_of(void *objp);
+void kmem_cache_init(void);
+void kmem_cache_print_stat(void);
+void check_slab(void);
+
+#endif /* !__KERN_MM_SLAB_H__ */
@@ -0,0 +1,10 @@
+#ifndef __KERN_MM_SLOB_H__
+#define __KERN_MM_SLOB_H__
+
+#include <defs.h>
+
+/* the first-fit SLOB allocator kmalloc used to be, kept to compare kmalloc with */
+void *slob_kmalloc(size_t size);
+void slob_kfree(void *block);
+
+#endif /* !__KERN_MM_SLOB_H__ */
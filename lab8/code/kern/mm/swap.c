@@ -6,7 +6,6 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <mmu.h>
-#include <default_pmm.h>
 #include <kdebug.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
@@ -103,6 +102,12 @@ swap_out(struct mm_struct *mm, int n, int in_tick)
           pte_t *ptep = get_pte(mm->pgdir, v, 0);
           assert((*ptep & PTE_V) != 0);
 
+          if (page_pinned(page)) {
+                    // the kernel is accessing the page in place (user_mem_pin), keep it
+                    sm->map_swappable(mm, v, page, 0);
+                    continue;
+          }
+
           if (swapfs_write( (page->pra_vaddr/PGSIZE+1)<<8, page) != 0) {
                     cprintf("SWAP: failed to save\n");
                     sm->map_swappable(mm, v, page, 0);
@@ -172,24 +177,16 @@ struct Page * check_rp[CHECK_VALID_PHY_PAGE_NUM];
 pte_t * check_ptep[CHECK_VALID_PHY_PAGE_NUM];
 unsigned int check_swap_addr[CHECK_VALID_VIR_PAGE_NUM];
 
-extern free_area_t free_area;
-
-#define free_list (free_area.free_list)
-#define nr_free (free_area.nr_free)
+// the free pages taken away from pmm_manager while check_swap runs
+static list_entry_t check_hold_list;
 
 static void
 check_swap(void)
 {
     //backup mem env
-     int ret, count = 0, total = 0, i;
-     list_entry_t *le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-        struct Page *p = le2page(le, page_link);
-        assert(PageProperty(p));
-        count ++, total += p->property;
-     }
-     assert(total == nr_free_pages());
-     cprintf("BEGIN check_swap: count %d, total %d\n",count,total);
+     int ret, i;
+     size_t nr_free_store = nr_free_pages();
+     cprintf("BEGIN check_swap: total %d\n", nr_free_store);
      
      //now we set the phy pages env     
      struct mm_struct *mm = mm_create();
@@ -220,18 +217,25 @@ check_swap(void)
           assert(check_rp[i] != NULL );
           assert(!PageProperty(check_rp[i]));
      }
-     list_entry_t free_list_store = free_list;
-     list_init(&free_list);
-     assert(list_empty(&free_list));
-     
-     //assert(alloc_page() == NULL);
-     
-     unsigned int nr_free_store = nr_free;
-     nr_free = 0;
+     // leave only the check pages free: take all other free pages away from
+     // pmm_manager, whatever its algorithm is, and give them back at the end.
+     // the pages cached in front of pmm_manager go back to it first
+     struct Page *page;
+     size_t nr_hold = 0;
+     pmm_cache_drain();
+     list_init(&check_hold_list);
+     while ((page = pmm_manager->alloc_pages(1)) != NULL) {
+          list_add(&check_hold_list, &(page->page_link));
+          nr_hold ++;
+     }
+     assert(nr_free_pages() == 0);
+
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
         free_pages(check_rp[i],1);
      }
-     assert(nr_free==CHECK_VALID_PHY_PAGE_NUM);
+     assert(nr_free_pages()==CHECK_VALID_PHY_PAGE_NUM);
+     // the check runs with the page magazines on: the check pages are held there
+     assert(pmm_manager->nr_free_pages() == 0);
      
      cprintf("set up init env for check_swap begin!\n");
      //setup initial vir_page<->phy_page environment for page relpacement algorithm 
@@ -240,7 +244,7 @@ check_swap(void)
      pgfault_num=0;
      
      check_content_set();
-     assert( nr_free == 0);         
+     assert(nr_free_pages() == 0);
      for(i = 0; i<MAX_SEQ_NO ; i++) 
          swap_out_seq_no[i]=swap_in_seq_no[i]=-1;
      
@@ -257,8 +261,13 @@ check_swap(void)
      ret=check_content_access();
      assert(ret==0);
 
-     nr_free = nr_free_store;
-     free_list = free_list_store;
+     while (!list_empty(&check_hold_list)) {
+          list_entry_t *le = list_next(&check_hold_list);
+          list_del(le);
+          pmm_manager->free_pages(le2page(le, page_link), 1);
+          nr_hold --;
+     }
+     assert(nr_hold == 0);
 
      //restore kernel mem env
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
@@ -277,13 +286,7 @@ check_swap(void)
      pgdir[0] = 0;
      flush_tlb();
 
-     le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-         struct Page *p = le2page(le, page_link);
-         count --, total -= p->property;
-     }
-     assert(count==0);
-     assert(total==0);
+     assert(nr_free_pages() == nr_free_store);
 
      cprintf("check_swap() succeeded!\n");
 }
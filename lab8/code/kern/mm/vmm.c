@@ -8,6 +8,11 @@
 #include <riscv.h>
 #include <swap.h>
 #include <kmalloc.h>
+#include <slab.h>
+#include <inode.h>
+#include <stat.h>
+#include <iobuf.h>
+#include <pcache.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
@@ -39,16 +44,41 @@ static void check_vmm(void);
 static void check_vma_struct(void);
 static void check_pgfault(void);
 
+static struct kmem_cache *mm_cachep, *vma_cachep;
+
+// the page every untouched anonymous page is mapped to on a read, copy-on-write if writable.
+// vmm holds a reference on it, so it is never freed and never made writable in place.
+static struct Page *zero_page;
+
+/*
+ * fault-around: a read fault on a page which was not mapped also maps the pages around it
+ * that need neither allocation nor I/O: file pages already in the page cache, and the zero
+ * page for untouched anonymous memory or pure BSS. the window is fault_around_pages pages
+ * aligned to its size (so it never leaves the page table of the fault), a program reading
+ * its text or data sequentially takes one fault per window instead of one per page.
+ */
+#define FAULT_AROUND_PAGES          16
+
+static size_t fault_around_pages = FAULT_AROUND_PAGES;
+
+static struct fault_around_stat {
+    size_t faults;                  // faults which mapped pages around them
+    size_t mapped;                  // pages mapped ahead, each of them a fault avoided if touched
+} fastat;
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
-    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 
     if (mm != NULL) {
         list_init(&(mm->mmap_list));
+        mm->mmap_tree = NULL;
         mm->mmap_cache = NULL;
         mm->pgdir = NULL;
         mm->map_count = 0;
+        mm->brk_start = mm->brk = 0;
+        mm->context = 0;
 
         if (swap_init_ok) swap_init_mm(mm);
         else mm->sm_priv = NULL;
@@ -62,16 +92,55 @@ mm_create(void) {
 // vma_create - alloc a vma_struct & initialize it. (addr range: vm_start~vm_end)
 struct vma_struct *
 vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
-    struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+    struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 
     if (vma != NULL) {
         vma->vm_start = vm_start;
         vma->vm_end = vm_end;
         vma->vm_flags = vm_flags;
+        vma->vm_file = NULL;
+        vma->vm_fstart = vma->vm_filesz = vma->vm_offset = 0;
     }
     return vma;
 }
 
+// vma_destroy - drop the file reference of a vma & free it
+static void
+vma_destroy(struct vma_struct *vma) {
+    if (vma->vm_file != NULL) {
+        vop_ref_dec(vma->vm_file);
+    }
+    kmem_cache_free(vma_cachep, vma);
+}
+
+// vma_copy_file - make @to map the same file range as @from
+static void
+vma_copy_file(struct vma_struct *to, struct vma_struct *from) {
+    if ((to->vm_file = from->vm_file) != NULL) {
+        vop_ref_inc(to->vm_file);
+        to->vm_fstart = from->vm_fstart, to->vm_filesz = from->vm_filesz;
+        to->vm_offset = from->vm_offset;
+    }
+}
+
+
+// vma_compare - order vmas by their start addr, used by the redblack tree
+static int
+vma_compare(rb_node *node1, rb_node *node2) {
+    uintptr_t start1 = rbn2vma(node1, rb_link)->vm_start, start2 = rbn2vma(node2, rb_link)->vm_start;
+    return (start1 < start2) ? -1 : (start1 > start2) ? 1 : 0;
+}
+
+// vma_compare_addr - is the vma below (<0), containing (0) or above (>0) the addr in @key ?
+static int
+vma_compare_addr(rb_node *node, void *key) {
+    struct vma_struct *vma = rbn2vma(node, rb_link);
+    uintptr_t addr = (uintptr_t)key;
+    if (addr < vma->vm_start) {
+        return 1;
+    }
+    return (addr >= vma->vm_end) ? -1 : 0;
+}
 
 // find_vma - find a vma  (vma->vm_start <= addr <= vma_vm_end)
 struct vma_struct *
@@ -80,6 +149,11 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     if (mm != NULL) {
         vma = mm->mmap_cache;
         if (!(vma != NULL && vma->vm_start <= addr && vma->vm_end > addr)) {
+            if (mm->mmap_tree != NULL) {
+                rb_node *node = rb_search(mm->mmap_tree, vma_compare_addr, (void *)addr);
+                vma = (node != NULL) ? rbn2vma(node, rb_link) : NULL;
+            }
+            else {
                 bool found = 0;
                 list_entry_t *list = &(mm->mmap_list), *le = list;
                 while ((le = list_next(le)) != list) {
@@ -92,6 +166,7 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
                 if (!found) {
                     vma = NULL;
                 }
+            }
         }
         if (vma != NULL) {
             mm->mmap_cache = vma;
@@ -100,6 +175,42 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     return vma;
 }
 
+// find_vma_after - find the first vma ending above addr, NULL if there is none
+static struct vma_struct *
+find_vma_after(struct mm_struct *mm, uintptr_t addr) {
+    struct vma_struct *vma = NULL;
+    if (mm->mmap_tree != NULL) {
+        rb_tree *tree = mm->mmap_tree;
+        rb_node *node = rb_node_root(tree);
+        while (node != NULL) {
+            struct vma_struct *tmp = rbn2vma(node, rb_link);
+            if (tmp->vm_end > addr) {
+                vma = tmp;
+                node = rb_node_left(tree, node);
+            }
+            else {
+                node = rb_node_right(tree, node);
+            }
+        }
+    }
+    else {
+        list_entry_t *list = &(mm->mmap_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            if (le2vma(le, list_link)->vm_end > addr) {
+                vma = le2vma(le, list_link);
+                break;
+            }
+        }
+    }
+    return vma;
+}
+
+// find_vma_intersection - find the first vma overlapping [start, end), NULL if the range is free
+struct vma_struct *
+find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct vma_struct *vma = find_vma_after(mm, start);
+    return (vma != NULL && vma->vm_start < end) ? vma : NULL;
+}
 
 // check_vma_overlap - check if vma1 overlaps vma2 ?
 static inline void
@@ -110,6 +221,20 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next) {
 }
 
 
+// build_vma_tree - index the vmas of mm by a redblack tree, once a linear search gets slow
+static void
+build_vma_tree(struct mm_struct *mm) {
+    rb_tree *tree;
+    if ((tree = rb_tree_create(vma_compare)) != NULL) {
+        list_entry_t *list = &(mm->mmap_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            rb_insert(tree, &(le2vma(le, list_link)->rb_link));
+        }
+        mm->mmap_tree = tree;
+    }
+    // else: out of memory, keep using the list
+}
+
 // insert_vma_struct -insert vma in mm's list link
 void
 insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
@@ -117,6 +242,17 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     list_entry_t *list = &(mm->mmap_list);
     list_entry_t *le_prev = list, *le_next;
 
+    if (mm->mmap_tree == NULL && mm->map_count + 1 >= RB_MIN_MAP_COUNT) {
+        build_vma_tree(mm);
+    }
+    if (mm->mmap_tree != NULL) {
+        rb_insert(mm->mmap_tree, &(vma->rb_link));
+        rb_node *prev = rb_node_prev(mm->mmap_tree, &(vma->rb_link));
+        if (prev != NULL) {
+            le_prev = &(rbn2vma(prev, rb_link)->list_link);
+        }
+    }
+    else {
         list_entry_t *le = list;
         while ((le = list_next(le)) != list) {
             struct vma_struct *mmap_prev = le2vma(le, list_link);
@@ -125,6 +261,7 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
             }
             le_prev = le;
         }
+    }
 
     le_next = list_next(le_prev);
 
@@ -142,6 +279,19 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     mm->map_count ++;
 }
 
+// remove_vma_struct - take vma out of mm's list link (and tree)
+static void
+remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
+    list_del(&(vma->list_link));
+    if (mm->mmap_tree != NULL) {
+        rb_delete(mm->mmap_tree, &(vma->rb_link));
+    }
+    if (mm->mmap_cache == vma) {
+        mm->mmap_cache = NULL;
+    }
+    mm->map_count --;
+}
+
 // mm_destroy - free mm and mm internal fields
 void
 mm_destroy(struct mm_struct *mm) {
@@ -150,9 +300,12 @@ mm_destroy(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le;
     while ((le = list_next(list)) != list) {
         list_del(le);
-        kfree(le2vma(le, list_link));  //kfree vma        
+        vma_destroy(le2vma(le, list_link));  //kfree vma
+    }
+    if (mm->mmap_tree != NULL) {
+        rb_tree_destroy(mm->mmap_tree);
     }
-    kfree(mm); //kfree mm
+    kmem_cache_free(mm_cachep, mm); //kfree mm
     mm=NULL;
 }
 
@@ -169,7 +322,7 @@ mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
     int ret = -E_INVAL;
 
     struct vma_struct *vma;
-    if ((vma = find_vma(mm, start)) != NULL && end > vma->vm_start) {
+    if (find_vma_intersection(mm, start, end) != NULL) {
         goto out;
     }
     ret = -E_NO_MEM;
@@ -187,9 +340,155 @@ out:
     return ret;
 }
 
+/*
+ * mm_map_file - map [addr, addr + len) so that it is filled from @node on first touch:
+ *               the @filesz bytes at @addr come from the file at @offset, the rest of
+ *               the range (e.g. the BSS of a program) reads as zero.
+ *               no page is allocated here, do_pgfault brings them in one by one.
+ */
+int
+mm_map_file(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
+            struct inode *node, off_t offset, size_t filesz) {
+    assert(node != NULL && filesz <= len);
+    int ret;
+    struct vma_struct *vma;
+    if ((ret = mm_map(mm, addr, len, vm_flags, &vma)) != 0) {
+        return ret;
+    }
+    vop_ref_inc(node);
+    vma->vm_file = node;
+    vma->vm_fstart = addr, vma->vm_filesz = filesz;
+    vma->vm_offset = offset;
+    return 0;
+}
+
+/*
+ * vma_unmap_range - unmap [start, end) of @vma. a page written through a shared file mapping
+ *                   is marked dirty again, it may have been written since its last writeback.
+ */
+static void
+vma_unmap_range(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    if (vma->vm_flags & VM_SHARED) {
+        uintptr_t la;
+        for (la = start; la < end; la += PGSIZE) {
+            pte_t *ptep = get_pte(mm->pgdir, la, 0);
+            if (ptep != NULL && (*ptep & PTE_V) && (*ptep & PTE_W)) {
+                struct Page *page = pte2page(*ptep);
+                if (page->mapping != NULL) {
+                    pcache_set_dirty(page);
+                }
+            }
+        }
+    }
+    unmap_range(mm->pgdir, start, end);
+}
+
+/*
+ * mm_unmap - remove [addr, addr + len) from @mm: the vmas inside it are freed, those
+ *            crossing its ends are shrunk (or split in two), and the pages are unmapped.
+ */
+int
+mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    // a megapage unmapped in part is split now, while failing still leaves everything as it was
+    int ret;
+    if ((ret = megapage_split_at(mm->pgdir, start)) != 0 || (ret = megapage_split_at(mm->pgdir, end)) != 0) {
+        return ret;
+    }
+
+    struct vma_struct *vma = find_vma_after(mm, start), *nvma;
+    list_entry_t *list = &(mm->mmap_list), *le = (vma != NULL) ? &(vma->list_link) : list;
+    while (le != list) {
+        vma = le2vma(le, list_link);
+        le = list_next(le);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start < start && end < vma->vm_end) {
+            // a hole in the middle, the part above it becomes a new vma
+            if ((nvma = vma_create(end, vma->vm_end, vma->vm_flags)) == NULL) {
+                return -E_NO_MEM;
+            }
+            vma_copy_file(nvma, vma);
+            vma_unmap_range(mm, vma, start, end);
+            vma->vm_end = start;
+            insert_vma_struct(mm, nvma);
+            break;
+        }
+        uintptr_t un_start = (vma->vm_start > start) ? vma->vm_start : start;
+        uintptr_t un_end = (vma->vm_end < end) ? vma->vm_end : end;
+        vma_unmap_range(mm, vma, un_start, un_end);
+        if (vma->vm_start < start) {
+            vma->vm_end = start;
+        }
+        else if (end < vma->vm_end) {
+            vma->vm_start = end;
+        }
+        else {
+            remove_vma_struct(mm, vma);
+            vma_destroy(vma);
+        }
+    }
+    mm->mmap_cache = NULL;
+    // page tables left empty are freed
+    exit_range(mm->pgdir, start, end);
+    return 0;
+}
+
+/*
+ * get_unmapped_area - find a free range of @len bytes for a new mapping, the highest one
+ *                     below the user stack, so it stays clear of the program and its heap.
+ *                     return 0 if there is no room.
+ */
+uintptr_t
+get_unmapped_area(struct mm_struct *mm, size_t len) {
+    len = ROUNDUP(len, PGSIZE);
+    uintptr_t top = USERTOP;
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_prev(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_end <= top && top - vma->vm_end >= len) {
+            return top - len;
+        }
+        top = vma->vm_start;
+    }
+    if (top >= USERBASE && top - USERBASE >= len) {
+        return top - len;
+    }
+    return 0;
+}
+
+/*
+ * mm_brk - grow the heap by [addr, addr + len): anonymous read/write memory brought in
+ *          on first touch, added to the heap vma right below it if there is one.
+ */
+int
+mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+    if (find_vma_intersection(mm, start, end) != NULL) {
+        return -E_INVAL;
+    }
+    struct vma_struct *vma = find_vma(mm, start - 1);
+    if (vma != NULL && vma->vm_end == start && vma->vm_flags == (VM_READ | VM_WRITE) && vma->vm_file == NULL) {
+        vma->vm_end = end;
+        return 0;
+    }
+    return mm_map(mm, start, end - start, VM_READ | VM_WRITE, NULL);
+}
+
 int
 dup_mmap(struct mm_struct *to, struct mm_struct *from) {
     assert(to != NULL && from != NULL);
+    to->brk_start = from->brk_start, to->brk = from->brk;
     list_entry_t *list = &(from->mmap_list), *le = list;
     while ((le = list_prev(le)) != list) {
         struct vma_struct *vma, *nvma;
@@ -198,10 +497,15 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
         if (nvma == NULL) {
             return -E_NO_MEM;
         }
+        vma_copy_file(nvma, vma);
 
         insert_vma_struct(to, nvma);
+        if (vma->vm_flags & VM_SHARED) {
+            // the child faults the pages in from the page cache, just like the parent did
+            continue;
+        }
 
-        bool share = 0;
+        bool share = 1;
         if (copy_range(to->pgdir, from->pgdir, vma->vm_start, vma->vm_end, share) != 0) {
             return -E_NO_MEM;
         }
@@ -216,7 +520,7 @@ exit_mmap(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le = list;
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
-        unmap_range(pgdir, vma->vm_start, vma->vm_end);
+        vma_unmap_range(mm, vma, vma->vm_start, vma->vm_end);
     }
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
@@ -242,10 +546,69 @@ copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
     return 1;
 }
 
+/*
+ * user_mem_pin - bring the user pages of [addr, addr + len) into memory (with write access if @write)
+ *                and pin them, so the kernel can access the user buffer in place, e.g. as the target
+ *                of a file read. the pages are stored in @pages.
+ *                NOTICE: call user_mem_check first, and hold lock_mm while pinning. the pinned pages
+ *                are neither freed, swapped out nor reclaimed until user_mem_unpin, so lock_mm can be
+ *                dropped for a long I/O; but then the user mapping may change, use page2kva instead.
+ */
+int
+user_mem_pin(struct mm_struct *mm, uintptr_t addr, size_t len, bool write, struct Page **pages) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    size_t n = 0;
+    int ret;
+    for (; start < end; start += PGSIZE) {
+        pde_t *pdep = get_pde(mm->pgdir, start, 0);
+        if (pdep != NULL && pde_is_megapage(*pdep) && (!write || (*pdep & PTE_W))) {
+            pages[n] = pte2page(*pdep) + PTX(start);
+            page_ref_inc(pages[n]), page_pin(pages[n ++]);
+            continue;
+        }
+        pte_t *ptep = get_pte(mm->pgdir, start, 0);
+        if (ptep == NULL || !(*ptep & PTE_V) || (write && !(*ptep & PTE_W))) {
+            uint_t cause = (write) ? CAUSE_STORE_PAGE_FAULT : CAUSE_LOAD_PAGE_FAULT;
+            if ((ret = do_pgfault(mm, cause, start)) != 0) {
+                goto failed;
+            }
+            ptep = get_pte(mm->pgdir, start, 0);
+            assert(ptep != NULL && (*ptep & PTE_V));
+        }
+        pages[n] = pte2page(*ptep);
+        page_ref_inc(pages[n]), page_pin(pages[n ++]);
+    }
+    return 0;
+
+failed:
+    user_mem_unpin(pages, n);
+    return ret;
+}
+
+// user_mem_unpin - unpin the pages pinned by user_mem_pin, and drop their references
+void
+user_mem_unpin(struct Page **pages, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i ++) {
+        page_unpin(pages[i]);
+        if (page_ref_dec(pages[i]) == 0) {
+            free_page(pages[i]);
+        }
+    }
+}
+
 // vmm_init - initialize virtual memory management
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    if ((mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct), NULL)) == NULL ||
+        (vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct), NULL)) == NULL) {
+        panic("cannot create mm caches.\n");
+    }
+    if ((zero_page = alloc_zeroed_page()) == NULL) {
+        panic("cannot alloc the zero page.\n");
+    }
+    set_page_ref(zero_page, 1);
     check_vmm();
 }
 
@@ -254,6 +617,7 @@ static void
 check_vmm(void) {
     // size_t nr_free_pages_store = nr_free_pages();
     
+    check_rb_tree();
     check_vma_struct();
     check_pgfault();
 
@@ -354,8 +718,26 @@ check_pgfault(void) {
 
     assert(sum == 0);
 
+    // reading an untouched page maps the zero page, the first write gives it a page of its own
+    size_t nr_free_pages_read = nr_free_pages();
+    uintptr_t zaddr = addr + PGSIZE;
+    for (i = 0; i < 100; i ++) {
+        assert(*(char *)(zaddr + i) == 0);
+    }
+    assert(get_page(pgdir, zaddr, NULL) == zero_page && nr_free_pages() == nr_free_pages_read);
+    if (fault_around_pages > 2) {
+        assert(get_page(pgdir, zaddr + PGSIZE, NULL) == zero_page);
+    }
+    *(char *)zaddr = 1;
+    assert(get_page(pgdir, zaddr, NULL) != zero_page && *(char *)zaddr == 1 && *(char *)(zaddr + 1) == 0);
+
     pde_t *pd1=pgdir,*pd0=page2kva(pde2page(pgdir[0]));
-    page_remove(pgdir, ROUNDDOWN(addr, PGSIZE));
+    // the read fault also mapped the zero page around zaddr
+    uintptr_t la;
+    for (la = 0; la < PTSIZE; la += PGSIZE) {
+        page_remove(pgdir, la);
+    }
+    assert(page_ref(zero_page) == 1);
     free_page(pde2page(pd0[0]));
     free_page(pde2page(pd1[0]));
     pgdir[0] = 0;
@@ -372,6 +754,267 @@ check_pgfault(void) {
 //page fault number
 volatile unsigned int pgfault_num=0;
 
+/*
+ * do_cow_page - resolve a write to the copy-on-write page mapped by @ptep at @addr:
+ *               the last user of the page just gets it writable again, otherwise the
+ *               faulting process gets a private copy.
+ */
+static int
+do_cow_page(struct mm_struct *mm, uintptr_t addr, pte_t *ptep, uint32_t perm) {
+    struct Page *page = pte2page(*ptep), *npage;
+    if (page == zero_page) {
+        // nothing to copy
+        if ((npage = alloc_zeroed_page()) == NULL) {
+            return -E_NO_MEM;
+        }
+        return page_insert(mm->pgdir, npage, addr, perm);
+    }
+    if (page_ref(page) == 1) {
+        *ptep = (*ptep | PTE_W) & ~PTE_COW;
+        tlb_invalidate(mm->pgdir, addr);
+        return 0;
+    }
+    if ((npage = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    memcpy(page2kva(npage), page2kva(page), PGSIZE);
+    // page_insert drops our reference on the shared page
+    return page_insert(mm->pgdir, npage, addr, perm);
+}
+
+/*
+ * file_page_read - read the page at @addr of the file-backed @vma into a new page:
+ *                  the part of the page inside [vm_fstart, vm_fstart + vm_filesz) comes
+ *                  from the file, the rest of it (the BSS, or past the end of the file) is zeroed.
+ *                  the page is handed back with a reference for the caller.
+ */
+static int
+file_page_read(struct vma_struct *vma, uintptr_t addr, struct Page **page_store) {
+    struct Page *page;
+    uintptr_t start = addr, end = addr + PGSIZE, fend = vma->vm_fstart + vma->vm_filesz;
+    if (start < vma->vm_fstart) {
+        start = vma->vm_fstart;
+    }
+    if (end > fend) {
+        end = fend;
+    }
+    // a page of pure BSS may come cleared already
+    if ((page = (start < end) ? alloc_page() : alloc_zeroed_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    void *kva = page2kva(page);
+
+    if (start < end) {
+        memset(kva, 0, start - addr);
+        memset(kva + (end - addr), 0, addr + PGSIZE - end);
+        struct iobuf __iob, *iob = iobuf_init(&__iob, kva + (start - addr), end - start,
+                                              vma->vm_offset + (start - vma->vm_fstart));
+        int ret;
+        if ((ret = vop_read(vma->vm_file, iob)) != 0) {
+            free_page(page);
+            return ret;
+        }
+        // the file has shrunk since it was mapped
+        memset(kva + (start - addr) + iobuf_used(iob), 0, iob->io_resid);
+    }
+    set_page_ref(page, 1);
+    *page_store = page;
+    return 0;
+}
+
+/*
+ * do_file_page - bring in the page at @addr of the file-backed @vma on its first touch.
+ *                a page lying wholly in the file range is mapped straight from the page
+ *                cache, so nothing is copied: read-only until the first write for a shared
+ *                mapping, copy-on-write for a private one (a private page written at once
+ *                gets its own copy right away). other pages are read by file_page_read.
+ */
+static int
+do_file_page(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm, bool write) {
+    struct Page *page = NULL;
+    off_t pos = vma->vm_offset + (off_t)(addr - vma->vm_fstart);
+    bool whole = (vma->vm_fstart <= addr && addr + PGSIZE <= vma->vm_fstart + vma->vm_filesz &&
+                  pos % PGSIZE == 0 && vma->vm_file->in_ops->vop_getpage != NULL);
+
+    int ret;
+    if (vma->vm_flags & VM_SHARED) {
+        if (!whole) {
+            return -E_INVAL;
+        }
+        // do_mmap keeps a shared mapping inside the file, but the file may have shrunk since:
+        // there is no page to map, the access is a fault of the process
+        struct stat __stat, *stat = &__stat;
+        if ((ret = vop_fstat(vma->vm_file, stat)) != 0) {
+            return ret;
+        }
+        if (pos >= stat->st_size) {
+            return -E_FAULT;
+        }
+        if ((ret = vop_getpage(vma->vm_file, pos / PGSIZE, &page)) != 0) {
+            return ret;
+        }
+        if (write) {
+            pcache_set_dirty(page);
+        }
+        else {
+            perm &= ~PTE_W;
+        }
+    }
+    else if (whole && !write && vop_getpage(vma->vm_file, pos / PGSIZE, &page) == 0) {
+        if (perm & PTE_W) {
+            perm = (perm & ~PTE_W) | PTE_COW;
+        }
+    }
+    else if (!write && (addr + PGSIZE <= vma->vm_fstart || addr >= vma->vm_fstart + vma->vm_filesz)) {
+        // a page of pure BSS is read as the zero page until it is written
+        page = zero_page;
+        page_ref_inc(page);
+        if (perm & PTE_W) {
+            perm = (perm & ~PTE_W) | PTE_COW;
+        }
+    }
+    else if ((ret = file_page_read(vma, addr, &page)) != 0) {
+        return ret;
+    }
+
+    // reading the file may sleep, and a thread sharing @mm may have brought the page in meanwhile
+    pte_t *ptep;
+    if ((ptep = get_pte(mm->pgdir, addr, 1)) == NULL) {
+        ret = -E_NO_MEM;
+    }
+    else {
+        ret = (*ptep == 0) ? page_insert(mm->pgdir, page, addr, perm) : 0;
+    }
+    // the mapping holds its own reference now
+    if (page_ref_dec(page) == 0) {
+        free_page(page);
+    }
+    return ret;
+}
+
+/*
+ * do_shared_write - the first write to a page of a shared file mapping: the page cache
+ *                   page becomes dirty, and stays writable until it is unmapped.
+ */
+static int
+do_shared_write(struct mm_struct *mm, uintptr_t addr, pte_t *ptep) {
+    struct Page *page = pte2page(*ptep);
+    if (page->mapping != NULL) {
+        pcache_set_dirty(page);
+    }
+    *ptep |= PTE_W;
+    tlb_invalidate(mm->pgdir, addr);
+    return 0;
+}
+
+// vmm_set_fault_around - use a fault-around window of @npages pages (a power of 2), 1 turns it off
+void
+vmm_set_fault_around(size_t npages) {
+    assert(npages != 0 && npages <= NPTEENTRY && (npages & (npages - 1)) == 0);
+    fault_around_pages = npages;
+}
+
+void
+vmm_print_stat(void) {
+    cprintf("fault-around: window %d pages, %d faults mapped %d pages ahead.\n",
+            fault_around_pages, fastat.faults, fastat.mapped);
+}
+
+/*
+ * fault_around_page - the page ready to be mapped at @la of @vma, with a reference for the
+ *                     caller, NULL if there is none. *@perm_store is made read-only (or
+ *                     copy-on-write) as for a read fault.
+ */
+static struct Page *
+fault_around_page(struct vma_struct *vma, uintptr_t la, uint32_t *perm_store) {
+    struct Page *page = NULL;
+    uintptr_t fend = vma->vm_fstart + vma->vm_filesz;
+    if (vma->vm_file == NULL || la + PGSIZE <= vma->vm_fstart || la >= fend) {
+        // a shared mapping past the end of the file has no page to map
+        if (vma->vm_flags & VM_SHARED) {
+            return NULL;
+        }
+        page = zero_page;
+        page_ref_inc(page);
+    }
+    else {
+        off_t pos = vma->vm_offset + (off_t)(la - vma->vm_fstart);
+        if (la < vma->vm_fstart || la + PGSIZE > fend || pos % PGSIZE != 0 ||
+            vma->vm_file->in_ops->vop_findpage == NULL ||
+            vop_findpage(vma->vm_file, pos / PGSIZE, &page) != 0) {
+            return NULL;
+        }
+    }
+    if (vma->vm_flags & VM_SHARED) {
+        *perm_store &= ~PTE_W;
+    }
+    else if (*perm_store & PTE_W) {
+        *perm_store = (*perm_store & ~PTE_W) | PTE_COW;
+    }
+    return page;
+}
+
+// do_fault_around - map the pages around the read fault at @addr of @vma which are ready
+static void
+do_fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    uintptr_t size = fault_around_pages * PGSIZE;
+    uintptr_t start = ROUNDDOWN(addr, size), end = start + size, la;
+    if (start < vma->vm_start) {
+        start = vma->vm_start;
+    }
+    if (end > vma->vm_end) {
+        end = vma->vm_end;
+    }
+    size_t nr_mapped = 0;
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep;
+        if (la == addr || (ptep = get_pte(mm->pgdir, la, 0)) == NULL || *ptep != 0) {
+            continue;
+        }
+        uint32_t aperm = perm;
+        struct Page *page;
+        if ((page = fault_around_page(vma, la, &aperm)) == NULL) {
+            continue;
+        }
+        // looking up the page cache may sleep, a thread sharing @mm may have mapped la meanwhile
+        if ((ptep = get_pte(mm->pgdir, la, 0)) != NULL && *ptep == 0 &&
+            page_insert(mm->pgdir, page, la, aperm) == 0) {
+            nr_mapped ++;
+        }
+        if (page_ref_dec(page) == 0) {
+            free_page(page);
+        }
+    }
+    if (nr_mapped != 0) {
+        fastat.faults ++;
+        fastat.mapped += nr_mapped;
+    }
+}
+
+/*
+ * do_megapage - map the zero filled PTSIZE megapage holding @addr of the anonymous @vma.
+ *               fails if the megapage is not wholly inside @vma, if some 4K page is mapped
+ *               there already (checked before anything is allocated), or if there is no free
+ *               aligned block of NPTEENTRY pages; the fault is then served with a 4K page as usual.
+ */
+static int
+do_megapage(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    uintptr_t base = ROUNDDOWN(addr, PTSIZE);
+    if (base < vma->vm_start || base + PTSIZE > vma->vm_end || !megapage_mappable(mm->pgdir, base)) {
+        return -E_INVAL;
+    }
+    struct Page *page;
+    if ((page = alloc_megapage()) == NULL) {
+        return -E_NO_MEM;
+    }
+    memset(page2kva(page), 0, PTSIZE);
+    int ret;
+    if ((ret = megapage_insert(mm->pgdir, page, base, perm & PTE_USER)) != 0) {
+        free_pages(page, NPTEENTRY);
+    }
+    return ret;
+}
+
 /* do_pgfault - interrupt handler to process the page fault execption
  * @mm         : the control struct for a set of vma using the same PDT
  * @error_code : the error code recorded in trapframe->tf_err which is setted by x86 hardware
@@ -413,11 +1056,22 @@ do_pgfault(struct mm_struct *mm, uint_t error_code, uintptr_t addr) {
      *    continue process
      */
     uint32_t perm = PTE_U;
+    if (vma->vm_flags & VM_READ) {
+        perm |= READ_ONLY;
+    }
     if (vma->vm_flags & VM_WRITE) {
         perm |= READ_WRITE;
     }
+    if (vma->vm_flags & VM_EXEC) {
+        perm |= (PTE_X | PTE_V);
+    }
     addr = ROUNDDOWN(addr, PGSIZE);
 
+    // the whole megapage around addr is brought in at once when the vma covers it
+    if ((vma->vm_flags & VM_MEGAPAGE) && vma->vm_file == NULL && do_megapage(mm, vma, addr, perm) == 0) {
+        return 0;
+    }
+
     ret = -E_NO_MEM;
 
     pte_t *ptep=NULL;
@@ -444,11 +1098,44 @@ do_pgfault(struct mm_struct *mm, uint_t error_code, uintptr_t addr) {
         goto failed;
     }
 
-    if (*ptep == 0) {
-        if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
+    bool fresh = (*ptep == 0);
+    if (*ptep == 0 && vma->vm_file != NULL) {
+        if ((ret = do_file_page(mm, vma, addr, perm, error_code == CAUSE_STORE_PAGE_FAULT)) != 0) {
+            cprintf("do_file_page in do_pgfault failed %e\n", ret);
+            goto failed;
+        }
+    } else if (*ptep == 0 && error_code != CAUSE_STORE_PAGE_FAULT) {
+        // anonymous memory reads as zero, no memory is spent on it until it is written
+        if (perm & PTE_W) {
+            perm = (perm & ~PTE_W) | PTE_COW;
+        }
+        if ((ret = page_insert(mm->pgdir, zero_page, addr, perm)) != 0) {
+            goto failed;
+        }
+    } else if (*ptep == 0) {
+        struct Page *page;
+        if ((page = pgdir_alloc_zeroed_page(mm->pgdir, addr, perm)) == NULL) {
             cprintf("pgdir_alloc_page in do_pgfault failed\n");
             goto failed;
         }
+    } else if (*ptep & PTE_V) {
+        // the page is there, the only faults we handle are the first write to a page of a
+        // shared file mapping, and a write to a copy-on-write page
+        if (error_code != CAUSE_STORE_PAGE_FAULT || !(vma->vm_flags & VM_WRITE) ||
+            !((vma->vm_flags & VM_SHARED) || (*ptep & PTE_COW))) {
+            cprintf("do_pgfault: bad access %x to %x, pte %x\n", error_code, addr, *ptep);
+            ret = -E_INVAL;
+            goto failed;
+        }
+        if (vma->vm_flags & VM_SHARED) {
+            ret = do_shared_write(mm, addr, ptep);
+        }
+        else {
+            ret = do_cow_page(mm, addr, ptep, perm);
+        }
+        if (ret != 0) {
+            goto failed;
+        }
     } else {// if this pte is a swap entry, then load data from disk to a page with phy addr
            // and call page_insert to map the phy addr with logical addr
         /*LAB3 EXERCISE 3: YOUR CODE
@@ -494,6 +1181,9 @@ do_pgfault(struct mm_struct *mm, uint_t error_code, uintptr_t addr) {
             goto failed;
         }
    }
+    if (fresh && error_code != CAUSE_STORE_PAGE_FAULT && fault_around_pages > 1 && !(vma->vm_flags & VM_MEGAPAGE)) {
+        do_fault_around(mm, vma, addr, perm);
+    }
    ret = 0;
 failed:
     return ret;
@@ -7,8 +7,10 @@
 #include <sync.h>
 #include <sem.h>
 #include <proc.h>
+#include <rb_tree.h>
 //pre define
 struct mm_struct;
+struct inode;
 
 // the virtual continuous memory area(vma), [vm_start, vm_end), 
 // addr belong to a vma means  vma.vm_start<= addr <vma.vm_end 
@@ -18,22 +20,38 @@ struct vma_struct {
     uintptr_t vm_end;        // end addr of vma, not include the vm_end itself
     uint32_t vm_flags;       // flags of vma
     list_entry_t list_link;  // linear list link which sorted by start addr of vma
+    rb_node rb_link;         // redblack link which sorted by start addr of vma
+    struct inode *vm_file;   // the file this vma is mapped from, NULL for anonymous memory
+    uintptr_t vm_fstart;     // [vm_fstart, vm_fstart + vm_filesz) holds the file content
+    size_t vm_filesz;        // starting at vm_offset, the rest of the vma reads as zero
+    off_t vm_offset;
 };
 
 #define le2vma(le, member)                  \
     to_struct((le), struct vma_struct, member)
 
+#define rbn2vma(node, member)               \
+    to_struct((node), struct vma_struct, member)
+
 #define VM_READ                 0x00000001
 #define VM_WRITE                0x00000002
 #define VM_EXEC                 0x00000004
 #define VM_STACK                0x00000008
+#define VM_SHARED               0x00000010  // file mapping whose writes go to the file
+#define VM_MEGAPAGE             0x00000020  // anonymous memory mapped by PTSIZE megapages where it can be
+
+// below this many vmas a linear search of mmap_list is as fast as the tree
+#define RB_MIN_MAP_COUNT        32
 
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
     list_entry_t mmap_list;        // linear list link which sorted by start addr of vma
+    rb_tree *mmap_tree;            // redblack tree of vmas, built once there are RB_MIN_MAP_COUNT of them
     struct vma_struct *mmap_cache; // current accessed vma, used for speed purpose
     pde_t *pgdir;                  // the PDT of these vma
     int map_count;                 // the count of these vma
+    uintptr_t brk_start, brk;      // the heap is [brk_start, brk), right after the program's BSS
+    uint64_t context;              // generation | ASID this mm runs under, see switch_mm
     void *sm_priv;                 // the private data for swap manager
     int mm_count;                  // the number ofprocess which shared the mm
     semaphore_t mm_sem; // mutex for using dup_mmap fun to duplicat the mm
@@ -41,6 +59,7 @@ struct mm_struct {
 };
 
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
+struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
 
@@ -50,6 +69,8 @@ void mm_destroy(struct mm_struct *mm);
 void vmm_init(void);
 int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
            struct vma_struct **vma_store);
+int mm_map_file(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
+                struct inode *node, off_t offset, size_t filesz);
 int do_pgfault(struct mm_struct *mm, uint_t error_code, uintptr_t addr);
 
 int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len);
@@ -57,6 +78,8 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from);
 void exit_mmap(struct mm_struct *mm);
 uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
+void vmm_set_fault_around(size_t npages);
+void vmm_print_stat(void);
 
 extern volatile unsigned int pgfault_num;
 extern struct mm_struct *check_mm_struct;
@@ -65,6 +88,8 @@ bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len, bool writ
 bool copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len, bool writable);
 bool copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len);
 bool copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn);
+int user_mem_pin(struct mm_struct *mm, uintptr_t addr, size_t len, bool write, struct Page **pages);
+void user_mem_unpin(struct Page **pages, size_t n);
 
 static inline int
 mm_count(struct mm_struct *mm) {
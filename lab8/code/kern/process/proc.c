@@ -1,5 +1,6 @@
 #include <proc.h>
 #include <kmalloc.h>
+#include <slab.h>
 #include <string.h>
 #include <sync.h>
 #include <pmm.h>
@@ -7,6 +8,7 @@
 #include <sched.h>
 #include <elf.h>
 #include <vmm.h>
+#include <asid.h>
 #include <trap.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +17,10 @@
 #include <fs.h>
 #include <vfs.h>
 #include <sysfile.h>
+#include <file.h>
+#include <inode.h>
+#include <stat.h>
+#include <writeback.h>
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
 introduction:
@@ -84,10 +90,12 @@ void kernel_thread_entry(void);
 void forkrets(struct trapframe *tf);
 void switch_to(struct context *from, struct context *to);
 
+static struct kmem_cache *proc_cachep;
+
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 static struct proc_struct *
 alloc_proc(void) {
-    struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+    struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
     if (proc != NULL) {
     //LAB4:EXERCISE1 YOUR CODE
     /*
@@ -242,7 +250,12 @@ proc_run(struct proc_struct *proc) {
         struct proc_struct *prev = current, *next = proc;
         local_intr_save(intr_flag);
         current = proc;
-        lcr3(next->cr3);
+        if (next->mm != NULL) {
+            switch_mm(next->mm);
+        }
+        else {
+            lcr3(next->cr3);
+        }
         switch_to(&(prev->context), &(next->context));
         local_intr_restore(intr_flag);
        //LAB8 YOUR CODE : (update LAB4 steps)
@@ -528,7 +541,7 @@ bad_fork_cleanup_fs:  //for LAB8
 bad_fork_cleanup_kstack:
     put_kstack(proc);
 bad_fork_cleanup_proc:
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     goto fork_out;
 }
 
@@ -624,7 +637,8 @@ load_icode(int fd, int argc, char **kargv) {
      *  setup_pgdir      - setup pgdir in mm
      *  load_icode_read  - read raw data content of program file
      *  mm_map           - build new vma
-     *  pgdir_alloc_page - allocate new memory for  TEXT/DATA/BSS/stack parts
+     *  mm_map_file      - build new vma filled from the program file on page fault
+     *  pgdir_alloc_page - allocate new memory for stack parts
      *  lcr3             - update Page Directory Addr Register -- CR3
      */
   //You can Follow the code form LAB5 which you have completed  to complete 
@@ -633,10 +647,8 @@ load_icode(int fd, int argc, char **kargv) {
      * (3) copy TEXT/DATA/BSS parts in binary to memory space of process
      *    (3.1) read raw data content in file and resolve elfhdr
      *    (3.2) read raw data content in file and resolve proghdr based on info in elfhdr
-     *    (3.3) call mm_map to build vma related to TEXT/DATA
-     *    (3.4) callpgdir_alloc_page to allocate page for TEXT/DATA, read contents in file
-     *          and copy them into the new allocated pages
-     *    (3.5) callpgdir_alloc_page to allocate pages for BSS, memset zero in these pages
+     *    (3.3) call mm_map_file to build vma related to TEXT/DATA/BSS, the pages are
+     *          read from the file (TEXT/DATA) or zeroed (BSS) by do_pgfault on first touch
      * (4) call mm_map to setup user stack, and put parameters into user stack
      * (5) setup current process's mm, cr3, reset pgidr (using lcr3 MARCO)
      * (6) setup uargc and uargv in user stacks
@@ -659,8 +671,7 @@ load_icode(int fd, int argc, char **kargv) {
     if (setup_pgdir(mm) != 0) {
         goto bad_pgdir_cleanup_mm;
     }
-    //(3) copy TEXT/DATA section, build BSS parts in binary to memory space of process
-    struct Page *page;
+    //(3) map TEXT/DATA/BSS parts in binary to memory space of process
     //(3.1) get the file header of the bianry program (ELF format)
     struct elfhdr __elf;
     struct elfhdr *elf = &__elf;
@@ -674,8 +685,13 @@ load_icode(int fd, int argc, char **kargv) {
         ret = -E_INVAL_ELF;
         goto bad_elf_cleanup_pgdir;
     }
+    struct inode *node;
+    if ((ret = file_getinode(fd, &node)) != 0) {
+        goto bad_elf_cleanup_pgdir;
+    }
     struct proghdr __ph, *ph = &__ph;
-    uint32_t vm_flags, perm, phnum;
+    uint32_t vm_flags, phnum;
+    uintptr_t prog_end = 0;
     for (phnum = 0; phnum < elf->e_phnum; phnum ++) {
         off_t phoff = elf->e_phoff + sizeof(struct proghdr) * phnum;
         if ((ret = load_icode_read(fd, ph, sizeof(struct proghdr), phoff)) != 0) {
@@ -693,84 +709,36 @@ load_icode(int fd, int argc, char **kargv) {
             continue ;
             // do nothing here since static variables may not occupy any space
         }
-        //(3.5) call mm_map fun to setup the new vma ( ph->p_va, ph->p_memsz)
-        vm_flags = 0, perm = PTE_U | PTE_V;
+        //(3.5) call mm_map_file fun to setup the new vma ( ph->p_va, ph->p_memsz)
+        vm_flags = 0;
         if (ph->p_flags & ELF_PF_X) vm_flags |= VM_EXEC;
         if (ph->p_flags & ELF_PF_W) vm_flags |= VM_WRITE;
         if (ph->p_flags & ELF_PF_R) vm_flags |= VM_READ;
-        // modify the perm bits here for RISC-V
-        if (vm_flags & VM_READ) perm |= PTE_R;
-        if (vm_flags & VM_WRITE) perm |= (PTE_W | PTE_R);
-        if (vm_flags & VM_EXEC) perm |= PTE_X;
-        if ((ret = mm_map(mm, ph->p_va, ph->p_memsz, vm_flags, NULL)) != 0) {
+        //(3.6) TEXT/DATA/BSS pages are not allocated here: do_pgfault reads the TEXT/DATA
+        //      content from the file and zeroes the BSS when a page is first touched
+        if ((ret = mm_map_file(mm, ph->p_va, ph->p_memsz, vm_flags, node, ph->p_offset, ph->p_filesz)) != 0) {
             goto bad_cleanup_mmap;
         }
-        off_t offset = ph->p_offset;
-        size_t off, size;
-        uintptr_t start = ph->p_va, end, la = ROUNDDOWN(start, PGSIZE);
-
-        ret = -E_NO_MEM;
-
-        //(3.6) alloc memory, and  copy the contents of every program section (from, from+end) to process's memory (la, la+end)
-        end = ph->p_va + ph->p_filesz;
-        //(3.6.1) copy TEXT/DATA section of bianry program
-        while (start < end) {
-            if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
-                ret = -E_NO_MEM;
-                goto bad_cleanup_mmap;
-            }
-            off = start - la, size = PGSIZE - off, la += PGSIZE;
-            if (end < la) {
-                size -= la - end;
-            }
-            if ((ret = load_icode_read(fd, page2kva(page) + off, size, offset)) != 0) {
-                goto bad_cleanup_mmap;
-            }
-            start += size, offset += size;
-        }
-        //(3.6.2) build BSS section of binary program
-        end = ph->p_va + ph->p_memsz;
-
-        if (start < la) {
-            /* ph->p_memsz == ph->p_filesz */
-            if (start == end) {
-                continue ;
-            }
-            off = start + PGSIZE - la, size = PGSIZE - off;
-            if (end < la) {
-                size -= la - end;
-            }
-            memset(page2kva(page) + off, 0, size);
-            start += size;
-            assert((end < la && start == end) || (end >= la && start == la));
-        }
-        while (start < end) {
-            if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
-                ret = -E_NO_MEM;
-                goto bad_cleanup_mmap;
-            }
-            off = start - la, size = PGSIZE - off, la += PGSIZE;
-            if (end < la) {
-                size -= la - end;
-            }
-            memset(page2kva(page) + off, 0, size);
-            start += size;
+        if (prog_end < ph->p_va + ph->p_memsz) {
+            prog_end = ph->p_va + ph->p_memsz;
         }
     }
+    // the heap starts empty right after the program, see do_brk
+    mm->brk_start = mm->brk = ROUNDUP(prog_end, PGSIZE);
     //(4) build user stack memory
     vm_flags = VM_READ | VM_WRITE | VM_STACK;
     if ((ret = mm_map(mm, USTACKTOP - USTACKSIZE, USTACKSIZE, vm_flags, NULL)) != 0) {
         goto bad_cleanup_mmap;
     }
-    assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-PGSIZE , PTE_USER) != NULL);
-    assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-2*PGSIZE , PTE_USER) != NULL);
-    assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-3*PGSIZE , PTE_USER) != NULL);
-    assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-4*PGSIZE , PTE_USER) != NULL);
+    assert(pgdir_alloc_zeroed_page(mm->pgdir, USTACKTOP-PGSIZE , PTE_USER) != NULL);
+    assert(pgdir_alloc_zeroed_page(mm->pgdir, USTACKTOP-2*PGSIZE , PTE_USER) != NULL);
+    assert(pgdir_alloc_zeroed_page(mm->pgdir, USTACKTOP-3*PGSIZE , PTE_USER) != NULL);
+    assert(pgdir_alloc_zeroed_page(mm->pgdir, USTACKTOP-4*PGSIZE , PTE_USER) != NULL);
     //(5) set current process's mm, sr3, and set CR3 reg = physical addr of Page Directory
     mm_count_inc(mm);
     current->mm = mm;
     current->cr3 = PADDR(mm->pgdir);
-    lcr3(PADDR(mm->pgdir));
+    switch_mm(mm);
 
     //(6) setup trapframe for user environment
     uint32_t argv_size=0, i;
@@ -983,7 +951,7 @@ found:
     }
     local_intr_restore(intr_flag);
     put_kstack(proc);
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     return 0;
 }
 // do_kill - kill process with pid by set this process's flags with PF_EXITING
@@ -1068,16 +1036,35 @@ init_main(void *arg) {
     if (pid <= 0) {
         panic("create user_main failed.\n");
     }
+    int wbpid = kernel_thread(writeback_main, NULL, 0);
+    if (wbpid <= 0) {
+        panic("create writeback daemon failed.\n");
+    }
+    struct proc_struct *wbproc = find_proc(wbpid);
     extern void check_sync(void);
     //check_sync();                // check philosopher sync problem
+#ifdef KMALLOC_BENCH
+    extern void check_kmalloc_bench(void);
+    check_kmalloc_bench();          // compare kmalloc with slob, slob keeps its pages
+#endif
 
-    while (do_wait(0, NULL) == 0) {
+    // wait until the writeback daemon is the only child left
+    while (current->cptr != wbproc || wbproc->optr != NULL) {
+        if (do_wait(0, NULL) != 0) {
+            break;
+        }
         schedule();
     }
-    
+    writeback_stop();
+    if (do_wait(wbpid, NULL) != 0) {
+        panic("wait writeback daemon failed.\n");
+    }
+
     fs_cleanup();
     
     cprintf("all user-mode processes have quit.\n");
+    kmem_cache_print_stat();
+    vmm_print_stat();
     assert(initproc->cptr == NULL && initproc->yptr == NULL && initproc->optr == NULL);
     assert(nr_process == 2);
     assert(list_next(&proc_list) == &(initproc->list_link));
@@ -1097,6 +1084,9 @@ proc_init(void) {
     for (i = 0; i < HASH_LIST_SIZE; i ++) {
         list_init(hash_list + i);
     }
+    if ((proc_cachep = kmem_cache_create("proc_struct", sizeof(struct proc_struct), NULL)) == NULL) {
+        panic("cannot create proc_struct cache.\n");
+    }
 
     if ((idleproc = alloc_proc()) == NULL) {
         panic("cannot alloc idleproc.\n");
@@ -1137,6 +1127,10 @@ cpu_idle(void) {
         if (current->need_resched) {
             schedule();
         }
+        else {
+            // nothing to run, clear free pages for later anonymous faults
+            zero_page_idle();
+        }
     }
 }
 //FOR LAB6, set the process's priority (bigger value will get more CPU time)
@@ -1168,3 +1162,175 @@ do_sleep(unsigned int time) {
     del_timer(timer);
     return 0;
 }
+
+/*
+ * do_mmap - map @len bytes of memory into the current process, at *@addr_store if it is
+ *           free (or with MAP_FIXED), otherwise wherever there is room; the address is
+ *           stored back to *@addr_store. @mmap_flags holds the PROT_* and MAP_* bits.
+ *           an anonymous mapping is zero filled, a file mapping shows the file @fd from
+ *           @offset (page aligned), a shared one may not reach past the end of it. no page
+ *           is allocated or read here, do_pgfault brings them in on first touch, straight
+ *           from the page cache when possible.
+ */
+int
+do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mmap!!.\n");
+    }
+    if (addr_store == NULL || len == 0) {
+        return -E_INVAL;
+    }
+
+    bool shared = ((mmap_flags & MAP_SHARED) != 0);
+    if (shared == ((mmap_flags & MAP_PRIVATE) != 0)) {
+        return -E_INVAL;
+    }
+
+    uint32_t vm_flags = 0;
+    if (mmap_flags & PROT_READ) vm_flags |= VM_READ;
+    if (mmap_flags & PROT_WRITE) vm_flags |= VM_READ | VM_WRITE;
+    if (mmap_flags & PROT_EXEC) vm_flags |= VM_EXEC;
+
+    int ret;
+    struct inode *node = NULL;
+    if (mmap_flags & MAP_ANONYMOUS) {
+        if (shared) {
+            return -E_INVAL;
+        }
+        if (mmap_flags & MAP_MEGAPAGE) {
+            vm_flags |= VM_MEGAPAGE;
+        }
+    }
+    else {
+        if ((mmap_flags & MAP_MEGAPAGE) || offset < 0 || offset % PGSIZE != 0) {
+            return -E_INVAL;
+        }
+        if (!file_testfd(fd, 1, 0) || (shared && (vm_flags & VM_WRITE) && !file_testfd(fd, 0, 1))) {
+            return -E_INVAL;
+        }
+        if ((ret = file_getinode(fd, &node)) != 0) {
+            return ret;
+        }
+        if (node->in_ops->vop_getpage == NULL) {
+            // devices, pipes... can't be mapped
+            return -E_NA_DEV;
+        }
+        if (shared) {
+            // a shared mapping has no page to show past the end of the file
+            struct stat __stat, *stat = &__stat;
+            if ((ret = file_fstat(fd, stat)) != 0) {
+                return ret;
+            }
+            size_t fsize = ROUNDUP(stat->st_size, PGSIZE);
+            if ((size_t)offset > fsize || len > fsize - offset) {
+                return -E_INVAL;
+            }
+            vm_flags |= VM_SHARED;
+        }
+    }
+
+    len = ROUNDUP(len, PGSIZE);
+    uintptr_t addr;
+    lock_mm(mm);
+    if (!copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+        ret = -E_INVAL;
+        goto out_unlock;
+    }
+    if (mmap_flags & MAP_FIXED) {
+        ret = -E_INVAL;
+        if (addr % PGSIZE != 0 || (ret = mm_unmap(mm, addr, len)) != 0) {
+            goto out_unlock;
+        }
+    }
+    else if (addr % PGSIZE != 0 || !USER_ACCESS(addr, addr + len) ||
+             find_vma_intersection(mm, addr, addr + len) != NULL) {
+        // megapages need a PTSIZE aligned address, ask for room to align it
+        size_t slack = (vm_flags & VM_MEGAPAGE) ? PTSIZE - PGSIZE : 0;
+        if ((addr = get_unmapped_area(mm, len + slack)) == 0) {
+            ret = -E_NO_MEM;
+            goto out_unlock;
+        }
+        addr = ROUNDUP(addr, (slack != 0) ? PTSIZE : PGSIZE);
+    }
+
+    if (node != NULL) {
+        ret = mm_map_file(mm, addr, len, vm_flags, node, offset, len);
+    }
+    else {
+        ret = mm_map(mm, addr, len, vm_flags, NULL);
+    }
+    if (ret == 0 && !copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t))) {
+        mm_unmap(mm, addr, len);
+        ret = -E_INVAL;
+    }
+
+out_unlock:
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_munmap - unmap [addr, addr + len) of the current process
+int
+do_munmap(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call munmap!!.\n");
+    }
+    if (addr % PGSIZE != 0 || len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_unmap(mm, addr, len);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+/*
+ * do_brk - move the end of the heap (the program break) of the current process to *@brk_store,
+ *          or leave it alone if that is below the start of the heap (e.g. 0); the break in
+ *          effect is stored back to *@brk_store. growing only extends the heap vma, the
+ *          pages come in on first touch; shrinking unmaps the pages above the new break.
+ */
+int
+do_brk(uintptr_t *brk_store) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call sys_brk!!.\n");
+    }
+    if (brk_store == NULL) {
+        return -E_INVAL;
+    }
+
+    int ret = 0;
+    uintptr_t brk;
+    lock_mm(mm);
+    if (!copy_from_user(mm, &brk, brk_store, sizeof(uintptr_t), 1)) {
+        ret = -E_INVAL;
+        goto out_unlock;
+    }
+    if (brk >= mm->brk_start) {
+        uintptr_t newend = ROUNDUP(brk, PGSIZE), oldend = ROUNDUP(mm->brk, PGSIZE);
+        if (newend < oldend) {
+            ret = mm_unmap(mm, newend, oldend - newend);
+        }
+        else if (newend > oldend && mm_brk(mm, oldend, newend - oldend) != 0) {
+            // ran into another mapping
+            ret = -E_NO_MEM;
+        }
+        if (ret != 0) {
+            goto out_unlock;
+        }
+        mm->brk = brk;
+    }
+    if (!copy_to_user(mm, brk_store, &(mm->brk), sizeof(uintptr_t))) {
+        ret = -E_INVAL;
+    }
+
+out_unlock:
+    unlock_mm(mm);
+    return ret;
+}
@@ -102,5 +102,8 @@ int do_execve(const char *name, int argc, const char **argv);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid);
 int do_sleep(unsigned int time);
+int do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int do_munmap(uintptr_t addr, size_t len);
+int do_brk(uintptr_t *brk_store);
 #endif /* !__KERN_PROCESS_PROC_H__ */
 
@@ -75,6 +75,29 @@ sys_sleep(uint64_t arg[]) {
     unsigned int time = (unsigned int)arg[0];
     return do_sleep(time);
 }
+static int
+sys_mmap(uint64_t arg[]) {
+    uintptr_t *addr_store = (uintptr_t *)arg[0];
+    size_t len = (size_t)arg[1];
+    uint32_t mmap_flags = (uint32_t)arg[2];
+    int fd = (int)arg[3];
+    off_t offset = (off_t)arg[4];
+    return do_mmap(addr_store, len, mmap_flags, fd, offset);
+}
+
+static int
+sys_brk(uint64_t arg[]) {
+    uintptr_t *brk_store = (uintptr_t *)arg[0];
+    return do_brk(brk_store);
+}
+
+static int
+sys_munmap(uint64_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_munmap(addr, len);
+}
+
 static int
 sys_open(uint64_t arg[]) {
     const char *path = (const char *)arg[0];
@@ -158,6 +181,9 @@ static int (*syscalls[])(uint64_t arg[]) = {
     [SYS_gettime]           sys_gettime,
     [SYS_lab6_set_priority] sys_lab6_set_priority,
     [SYS_sleep]             sys_sleep,
+    [SYS_brk]               sys_brk,
+    [SYS_mmap]              sys_mmap,
+    [SYS_munmap]            sys_munmap,
     [SYS_open]              sys_open,
     [SYS_close]             sys_close,
     [SYS_read]              sys_read,
@@ -119,6 +119,20 @@ pgfault_handler(struct trapframe *tf) {
     return do_pgfault(mm, tf->cause, tf->tval);
 }
 
+/*
+ * pgfault_failed - a page fault could not be handled. a user access past the end of a
+ *                  shared file mapping (-E_FAULT) only kills the faulting process.
+ */
+static void
+pgfault_failed(struct trapframe *tf, int ret) {
+    print_trapframe(tf);
+    if (ret == -E_FAULT && current != NULL && !trap_in_kernel(tf)) {
+        cprintf("killed by kernel: %e.\n", ret);
+        do_exit(-E_KILLED);
+    }
+    panic("handle pgfault failed. %e\n", ret);
+}
+
 static volatile int in_swap_tick_event = 0;
 extern struct mm_struct *check_mm_struct;
 
@@ -245,20 +259,19 @@ void exception_handler(struct trapframe *tf) {
             cprintf("Environment call from M-mode\n");
             break;
         case CAUSE_FETCH_PAGE_FAULT:
-            cprintf("Instruction page fault\n");
+            // program text is brought in on first execution, see do_pgfault
+            if ((ret = pgfault_handler(tf)) != 0) {
+                pgfault_failed(tf, ret);
+            }
             break;
         case CAUSE_LOAD_PAGE_FAULT:
-            cprintf("Load page fault\n");
             if ((ret = pgfault_handler(tf)) != 0) {
-                print_trapframe(tf);
-                panic("handle pgfault failed. %e\n", ret);
+                pgfault_failed(tf, ret);
             }
             break;
         case CAUSE_STORE_PAGE_FAULT:
-            cprintf("Store/AMO page fault\n");
             if ((ret = pgfault_handler(tf)) != 0) {
-                print_trapframe(tf);
-                panic("handle pgfault failed. %e\n", ret);
+                pgfault_failed(tf, ret);
             }
             break;
         default:
@@ -134,6 +134,7 @@
 #define SATP64_MODE 0xF000000000000000
 #define SATP64_ASID 0x0FFFF00000000000
 #define SATP64_PPN  0x00000FFFFFFFFFFF
+#define SATP64_ASID_SHIFT 44
 
 #define SATP_MODE_OFF  0
 #define SATP_MODE_SV32 1
@@ -247,6 +248,11 @@ lcr3(unsigned long cr3) {
     write_csr(satp, 0x8000000000000000 | (cr3 >> RISCV_PGSHIFT));
 }
 
+static inline void
+lcr3_asid(unsigned long cr3, unsigned long asid) {
+    write_csr(satp, 0x8000000000000000 | (asid << SATP64_ASID_SHIFT) | (cr3 >> RISCV_PGSHIFT));
+}
+
 #endif
 
 #endif
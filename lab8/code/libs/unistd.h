@@ -14,6 +14,7 @@
 #define SYS_kill            12
 #define SYS_gettime         17
 #define SYS_getpid          18
+#define SYS_brk             19
 #define SYS_mmap            20
 #define SYS_munmap          21
 #define SYS_shmem           22
@@ -52,6 +53,16 @@
 
 #define NO_FD               -0x9527     // invalid fd
 
+/* mmap flags: one of MAP_SHARED / MAP_PRIVATE, then or in any of the others */
+#define PROT_READ           0x00000001  // pages may be read
+#define PROT_WRITE          0x00000002  // pages may be written
+#define PROT_EXEC           0x00000004  // pages may be executed
+#define MAP_SHARED          0x00000100  // writes go to the file and are seen by every mapping of it
+#define MAP_PRIVATE         0x00000200  // writes go to a private copy of the page
+#define MAP_ANONYMOUS       0x00000400  // zero filled memory backed by no file, private only
+#define MAP_FIXED           0x00000800  // map exactly at addr, replacing what is there
+#define MAP_MEGAPAGE        0x00001000  // back anonymous memory with 2M megapages, fewer TLB misses
+
 /* lseek codes */
 #define LSEEK_SET           0           // seek relative to beginning of file
 #define LSEEK_CUR           1           // seek relative to current position in file
@@ -0,0 +1,60 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * forkbench - fork latency vs. resident size.
+ * for each size the parent dirties that much memory, then forks ROUNDS children
+ * which exit at once (the fork-then-exec pattern of sh), and forks ROUNDS more
+ * which write every page of it (worst case for copy-on-write).
+ */
+
+#define PGSIZE          4096
+#define MAX_PAGES       256
+#define ROUNDS          20
+
+static char buffer[MAX_PAGES * PGSIZE];
+
+static void
+touch(int npages, char c) {
+    int i;
+    for (i = 0; i < npages; i ++) {
+        buffer[i * PGSIZE] = c;
+    }
+}
+
+static unsigned int
+run(int npages, bool write) {
+    unsigned int start = gettime_msec();
+    int i, pid;
+    for (i = 0; i < ROUNDS; i ++) {
+        if ((pid = fork()) == 0) {
+            if (write) {
+                touch(npages, 'c');
+            }
+            exit(0);
+        }
+        assert(pid > 0);
+        assert(wait() == 0);
+    }
+    return gettime_msec() - start;
+}
+
+int
+main(void) {
+    int npages;
+    cprintf("forkbench: %d forks per size, time in ms\n", ROUNDS);
+    cprintf("  pages   fork+exit   fork+write-all\n");
+    for (npages = 0; npages <= MAX_PAGES; npages = (npages == 0) ? 16 : npages * 2) {
+        touch(npages, 'p');
+        unsigned int t_exit = run(npages, 0);
+        unsigned int t_write = run(npages, 1);
+        cprintf("  %5d   %9d   %14d\n", npages, t_exit, t_write);
+        int i;
+        for (i = 0; i < npages; i ++) {
+            assert(buffer[i * PGSIZE] == 'p');
+        }
+    }
+    cprintf("forkbench pass.\n");
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <defs.h>
+#include <string.h>
+#include <unistd.h>
+#include <ulib.h>
+#include <malloc.h>
+
+#define PGSIZE                      4096
+#define MCLASS_LARGE                MALLOC_NCLASS
+
+/*
+ * every page handed out by the allocator starts with this header, so free can find
+ * it from the block address alone. the header is padded to MALLOC_MIN_SMALL bytes
+ * to keep the blocks behind it aligned.
+ */
+struct mpage {
+    uint32_t mclass;                            // size class of the blocks in this page, or MCLASS_LARGE
+    uint32_t npages;                            // # of pages of a large block
+};
+
+#define MPAGE_HDRSIZE               MALLOC_MIN_SMALL
+
+// a free small block, linked into the free list of its class
+struct mblock {
+    struct mblock *next;
+};
+
+static struct mblock *free_list[MALLOC_NCLASS];
+
+// heap pages got from sbrk but not given to a size class yet
+static uintptr_t pool_start, pool_end;
+
+static inline size_t
+class_size(int mclass) {
+    return MALLOC_MIN_SMALL << mclass;
+}
+
+static int
+size_class(size_t size) {
+    int mclass = 0;
+    while (class_size(mclass) < size) {
+        mclass ++;
+    }
+    return mclass;
+}
+
+/* heap_get_page - take one page from the heap, growing the heap when the pool is empty */
+static struct mpage *
+heap_get_page(void) {
+    if (pool_start == pool_end) {
+        void *base;
+        if ((base = sbrk(MALLOC_SBRK_PAGES * PGSIZE)) == NULL) {
+            return NULL;
+        }
+        pool_start = (uintptr_t)base, pool_end = pool_start + MALLOC_SBRK_PAGES * PGSIZE;
+        if (pool_start % PGSIZE != 0) {
+            // someone else moved the break by a partial page, skip up to the next page
+            pool_start = ROUNDUP(pool_start, PGSIZE);
+            pool_end = ROUNDDOWN(pool_end, PGSIZE);
+        }
+    }
+    struct mpage *page = (struct mpage *)pool_start;
+    pool_start += PGSIZE;
+    return page;
+}
+
+/* refill_class - carve a new heap page into free blocks of @mclass */
+static bool
+refill_class(int mclass) {
+    struct mpage *page;
+    if ((page = heap_get_page()) == NULL) {
+        return 0;
+    }
+    page->mclass = mclass, page->npages = 1;
+
+    size_t size = class_size(mclass);
+    uintptr_t addr = (uintptr_t)page + MPAGE_HDRSIZE;
+    // keep the blocks in address order on the free list
+    struct mblock **link = &free_list[mclass];
+    for (; addr + size <= (uintptr_t)page + PGSIZE; addr += size) {
+        struct mblock *block = (struct mblock *)addr;
+        *link = block, link = &(block->next);
+    }
+    *link = NULL;
+    return 1;
+}
+
+static void *
+malloc_large(size_t size) {
+    size_t npages = ROUNDUP(size + MPAGE_HDRSIZE, PGSIZE) / PGSIZE;
+    struct mpage *page;
+    if ((page = mmap(NULL, npages * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == NULL) {
+        return NULL;
+    }
+    page->mclass = MCLASS_LARGE, page->npages = npages;
+    return (void *)page + MPAGE_HDRSIZE;
+}
+
+/* malloc - allocate @size bytes, NULL if out of memory or @size is 0 */
+void *
+malloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > MALLOC_MAX_SMALL) {
+        return malloc_large(size);
+    }
+    int mclass = size_class(size);
+    if (free_list[mclass] == NULL && !refill_class(mclass)) {
+        return NULL;
+    }
+    struct mblock *block = free_list[mclass];
+    free_list[mclass] = block->next;
+    return block;
+}
+
+/* free - release a block got from malloc, @ptr may be NULL */
+void
+free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    struct mpage *page = (struct mpage *)ROUNDDOWN((uintptr_t)ptr, PGSIZE);
+    if (page->mclass == MCLASS_LARGE) {
+        assert(ptr == (void *)page + MPAGE_HDRSIZE);
+        munmap(page, page->npages * PGSIZE);
+        return;
+    }
+    assert(page->mclass < MALLOC_NCLASS);
+    struct mblock *block = ptr;
+    block->next = free_list[page->mclass];
+    free_list[page->mclass] = block;
+}
@@ -0,0 +1,22 @@
+#ifndef __USER_LIBS_MALLOC_H__
+#define __USER_LIBS_MALLOC_H__
+
+#include <defs.h>
+
+/*
+ * user heap allocator.
+ * small blocks (up to MALLOC_MAX_SMALL bytes) are rounded up to a power of two
+ * and carved out of heap pages got by sbrk, one size class per page; freed blocks
+ * go to the free list of their class and are reused first. larger blocks get pages
+ * of their own from mmap and are unmapped again by free. not safe across threads.
+ */
+
+#define MALLOC_MIN_SMALL            16          /* smallest size class */
+#define MALLOC_MAX_SMALL            1024        /* largest size class */
+#define MALLOC_NCLASS               7           /* 16, 32, ..., 1024 */
+#define MALLOC_SBRK_PAGES           16          /* # of heap pages got by each sbrk */
+
+void *malloc(size_t size);
+void free(void *ptr);
+
+#endif /* !__USER_LIBS_MALLOC_H__ */
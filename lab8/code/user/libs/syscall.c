@@ -96,6 +96,21 @@ sys_gettime(void) {
     return syscall(SYS_gettime);
 }
 
+int
+sys_brk(uintptr_t *brk_store) {
+    return syscall(SYS_brk, brk_store);
+}
+
+int
+sys_mmap(uintptr_t *addr_store, size_t len, uint64_t mmap_flags, int64_t fd, off_t offset) {
+    return syscall(SYS_mmap, addr_store, len, mmap_flags, fd, offset);
+}
+
+int
+sys_munmap(uintptr_t addr, size_t len) {
+    return syscall(SYS_munmap, addr, len);
+}
+
 int
 sys_exec(const char *name, int64_t argc, const char **argv) {
     return syscall(SYS_exec, name, argc, argv);
@@ -12,6 +12,9 @@ int sys_putc(int64_t c);
 int sys_pgdir(void);
 int sys_sleep(int64_t time);
 int sys_gettime(void);
+int sys_brk(uintptr_t *brk_store);
+int sys_mmap(uintptr_t *addr_store, size_t len, uint64_t mmap_flags, int64_t fd, off_t offset);
+int sys_munmap(uintptr_t addr, size_t len);
 
 struct stat;
 struct dirent;
@@ -62,6 +62,44 @@ int
 sleep(unsigned int time) {
     return sys_sleep(time);
 }
+
+/*
+ * sbrk - move the end of the heap by @increment bytes (may be negative).
+ *        return the old end, i.e. the start of the new memory, or NULL on failure.
+ */
+void *
+sbrk(intptr_t increment) {
+    uintptr_t brk = 0, newbrk;
+    if (sys_brk(&brk) != 0) {
+        return NULL;
+    }
+    if (increment != 0) {
+        newbrk = brk + increment;
+        if (sys_brk(&newbrk) != 0) {
+            return NULL;
+        }
+    }
+    return (void *)brk;
+}
+
+/*
+ * mmap - map @len bytes at @addr (only a hint unless MAP_FIXED is in @flags), anonymous
+ *        memory with MAP_ANONYMOUS, otherwise the file @fd from @offset.
+ *        return the address of the mapping, or NULL on failure.
+ */
+void *
+mmap(void *addr, size_t len, uint32_t prot, uint32_t flags, int fd, off_t offset) {
+    uintptr_t addr_store = (uintptr_t)addr;
+    if (sys_mmap(&addr_store, len, prot | flags, fd, offset) != 0) {
+        return NULL;
+    }
+    return (void *)addr_store;
+}
+
+int
+munmap(void *addr, size_t len) {
+    return sys_munmap((uintptr_t)addr, len);
+}
 int
 __exec(const char *name, const char **argv) {
     int argc = 0;
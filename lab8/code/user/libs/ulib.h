@@ -34,6 +34,9 @@ void print_pgdir(void);
 unsigned int gettime_msec(void);
 void lab6_set_priority(uint32_t priority);
 int sleep(unsigned int time);
+void *sbrk(intptr_t increment);
+void *mmap(void *addr, size_t len, uint32_t prot, uint32_t flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
 int fprintf(int fd, const char *fmt, ...);
 int __exec(const char *name, const char **argv);
 #endif /* !__USER_LIBS_ULIB_H__ */
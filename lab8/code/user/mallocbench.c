@@ -0,0 +1,106 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+/*
+ * mallocbench - allocation-heavy workload for the user heap.
+ * keeps up to NSLOTS blocks alive, and in each round either frees a random live
+ * block or allocates one of random size (mostly small, now and then a large one),
+ * checking that no block was overwritten while it was alive.
+ */
+
+#define NSLOTS          512
+#define ROUNDS          50000
+#define LARGE_ONE_IN    64
+#define LARGE_MAX       16384
+
+static char *slot[NSLOTS];
+static size_t slot_size[NSLOTS];
+static char *freed[NSLOTS];
+
+static inline char
+pattern(int i, size_t size) {
+    return (char)(i * 31 + size);
+}
+
+static size_t
+random_size(void) {
+    unsigned int r = (unsigned int)rand();
+    if (r % LARGE_ONE_IN == 0) {
+        return MALLOC_MAX_SMALL + 1 + (r / LARGE_ONE_IN) % LARGE_MAX;
+    }
+    // small sizes, biased toward the smallest classes like most programs
+    return 1 + (r / LARGE_ONE_IN) % ((r & 1) ? 64 : MALLOC_MAX_SMALL);
+}
+
+static void
+check_free(int i) {
+    size_t j, size = slot_size[i];
+    for (j = 0; j < size; j ++) {
+        assert(slot[i][j] == pattern(i, size));
+    }
+    free(slot[i]);
+    slot[i] = NULL;
+}
+
+static bool
+was_freed(char *p) {
+    int i;
+    for (i = 0; i < NSLOTS; i ++) {
+        if (freed[i] == p) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int
+main(void) {
+    srand(2023);
+    void *heap_start = sbrk(0);
+    unsigned int start = gettime_msec();
+    int i, round, nalloc = 0, nlarge = 0;
+    for (round = 0; round < ROUNDS; round ++) {
+        i = (unsigned int)rand() % NSLOTS;
+        if (slot[i] != NULL) {
+            check_free(i);
+            continue;
+        }
+        size_t size = random_size();
+        assert((slot[i] = malloc(size)) != NULL);
+        assert(((uintptr_t)slot[i] % sizeof(uintptr_t)) == 0);
+        memset(slot[i], pattern(i, size), size);
+        slot_size[i] = size, nalloc ++;
+        if (size > MALLOC_MAX_SMALL) {
+            nlarge ++;
+        }
+    }
+    for (i = 0; i < NSLOTS; i ++) {
+        if (slot[i] != NULL) {
+            check_free(i);
+        }
+    }
+    unsigned int msec = gettime_msec() - start;
+
+    cprintf("mallocbench: %d rounds, %d mallocs (%d large) in %d msec, heap grew %d KB.\n",
+            ROUNDS, nalloc, nlarge, msec, (int)((sbrk(0) - heap_start) / 1024));
+
+    // freed blocks are reused: a second round of the same mallocs gets the blocks of the first back
+    for (i = 0; i < NSLOTS; i ++) {
+        assert((freed[i] = malloc(MALLOC_MIN_SMALL)) != NULL);
+    }
+    for (i = 0; i < NSLOTS; i ++) {
+        free(freed[i]);
+    }
+    for (i = 0; i < NSLOTS; i ++) {
+        assert((slot[i] = malloc(MALLOC_MIN_SMALL)) != NULL && was_freed(slot[i]));
+    }
+    for (i = 0; i < NSLOTS; i ++) {
+        free(slot[i]);
+    }
+
+    cprintf("mallocbench pass.\n");
+    return 0;
+}
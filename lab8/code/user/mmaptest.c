@@ -0,0 +1,183 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <error.h>
+
+/*
+ * mmaptest - anonymous, private file and shared file mappings:
+ * zero fill, copy-on-write across fork, partial munmap, MAP_FIXED,
+ * private writes not reaching the file, shared writes reaching it,
+ * anonymous memory backed by megapages, a shared mapping outliving
+ * the end of its file.
+ */
+
+#define PGSIZE          4096
+#define NPAGES          8
+#define MAPSIZE         (NPAGES * PGSIZE)
+#define FILENAME        "mmaptest.dat"    // shipped in disk0, sfs can't create files
+#define MEGASIZE        (2 * 1024 * 1024)
+
+static char buf[PGSIZE];
+
+static void
+test_anonymous(void) {
+    char *p = mmap(NULL, MAPSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(p != NULL);
+    int i, pid;
+    for (i = 0; i < MAPSIZE; i ++) {
+        assert(p[i] == 0);
+    }
+    for (i = 0; i < NPAGES; i ++) {
+        p[i * PGSIZE] = 'a' + i;
+    }
+
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < NPAGES; i ++) {
+            assert(p[i * PGSIZE] == 'a' + i);
+            p[i * PGSIZE] = 'A' + i;
+        }
+        exit(0);
+    }
+    assert(pid > 0 && wait() == 0);
+    for (i = 0; i < NPAGES; i ++) {
+        assert(p[i * PGSIZE] == 'a' + i);
+    }
+
+    // punch a hole in the middle, then map it again
+    assert(munmap(p + 2 * PGSIZE, 2 * PGSIZE) == 0);
+    assert(p[PGSIZE] == 'b' && p[4 * PGSIZE] == 'e');
+    char *q = mmap(p + 2 * PGSIZE, 2 * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    assert(q == p + 2 * PGSIZE && q[0] == 0 && q[PGSIZE] == 0);
+    assert(munmap(p, MAPSIZE) == 0);
+    cprintf("anonymous mapping ok.\n");
+}
+
+static void
+test_file(void) {
+    int fd, i, j, pid;
+    assert((fd = open(FILENAME, O_RDWR | O_TRUNC)) >= 0);
+    for (i = 0; i < NPAGES; i ++) {
+        memset(buf, 'a' + i, PGSIZE);
+        assert(write(fd, buf, PGSIZE) == PGSIZE);
+    }
+
+    // private: the file shows through, writes stay in the process
+    char *p = mmap(NULL, MAPSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    assert(p != NULL);
+    for (i = 0; i < NPAGES; i ++) {
+        assert(p[i * PGSIZE] == 'a' + i && p[i * PGSIZE + PGSIZE - 1] == 'a' + i);
+    }
+    p[0] = 'X';
+    assert(seek(fd, 0, LSEEK_SET) == 0 && read(fd, buf, PGSIZE) == PGSIZE && buf[0] == 'a');
+    assert(munmap(p, MAPSIZE) == 0);
+
+    // shared: a child's writes are seen by the parent and reach the file
+    char *s = mmap(NULL, MAPSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(s != NULL);
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < NPAGES; i ++) {
+            s[i * PGSIZE] = 'A' + i;
+        }
+        exit(0);
+    }
+    assert(pid > 0 && wait() == 0);
+    for (i = 0; i < NPAGES; i ++) {
+        assert(s[i * PGSIZE] == 'A' + i);
+    }
+    assert(munmap(s, MAPSIZE) == 0);
+    assert(fsync(fd) == 0);
+    for (i = 0; i < NPAGES; i ++) {
+        assert(seek(fd, i * PGSIZE, LSEEK_SET) == 0 && read(fd, buf, PGSIZE) == PGSIZE);
+        assert(buf[0] == 'A' + i);
+        for (j = 1; j < PGSIZE; j ++) {
+            assert(buf[j] == 'a' + i);
+        }
+    }
+
+    // a mapping from the middle of the file
+    char *m = mmap(NULL, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 2 * PGSIZE);
+    assert(m != NULL && m[0] == 'C' && m[1] == 'c');
+    assert(munmap(m, PGSIZE) == 0);
+
+    // bad requests
+    assert(mmap(NULL, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 1) == NULL);
+    assert(mmap(NULL, PGSIZE, PROT_READ, MAP_SHARED | MAP_ANONYMOUS, -1, 0) == NULL);
+    assert(mmap(NULL, MAPSIZE + PGSIZE, PROT_READ, MAP_SHARED, fd, 0) == NULL);
+    assert(mmap(NULL, PGSIZE, PROT_READ, MAP_SHARED, fd, MAPSIZE) == NULL);
+    close(fd);
+    cprintf("file mapping ok.\n");
+}
+
+static void
+test_megapage(void) {
+    int fd, i, pid, n = 2 * MEGASIZE / PGSIZE;
+    char *p = mmap(NULL, 2 * MEGASIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_MEGAPAGE, -1, 0);
+    assert(p != NULL && (uintptr_t)p % MEGASIZE == 0);
+    for (i = 0; i < n; i ++) {
+        assert(p[i * PGSIZE] == 0);
+        p[i * PGSIZE] = 'a' + i % 26;
+    }
+
+    // fork copies the megapages
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < n; i ++) {
+            assert(p[i * PGSIZE] == 'a' + i % 26);
+            p[i * PGSIZE] = 'A' + i % 26;
+        }
+        exit(0);
+    }
+    assert(pid > 0 && wait() == 0);
+    for (i = 0; i < n; i ++) {
+        assert(p[i * PGSIZE] == 'a' + i % 26);
+    }
+
+    // a file read lands in a megapage
+    assert((fd = open(FILENAME, O_RDONLY)) >= 0);
+    assert(read(fd, p + PGSIZE, PGSIZE) == PGSIZE && p[PGSIZE] == 'A' && p[PGSIZE + 1] == 'a');
+    close(fd);
+
+    // unmapping part of a megapage keeps the rest of it
+    assert(munmap(p + PGSIZE, 2 * PGSIZE) == 0);
+    assert(p[0] == 'a' && p[3 * PGSIZE] == 'a' + 3);
+    for (i = 3; i < n; i ++) {
+        assert(p[i * PGSIZE] == 'a' + i % 26);
+    }
+    assert(munmap(p, 2 * MEGASIZE) == 0);
+
+    // file mappings can't use megapages
+    assert(mmap(NULL, MEGASIZE, PROT_READ, MAP_PRIVATE | MAP_MEGAPAGE, 0, 0) == NULL);
+    cprintf("megapage mapping ok.\n");
+}
+
+static void
+test_file_shrink(void) {
+    int fd, pid, code;
+    assert((fd = open(FILENAME, O_RDWR)) >= 0);
+    char *s = mmap(NULL, MAPSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(s != NULL);
+
+    // the file is truncated under the mapping: touching it kills the process, not the kernel
+    if ((pid = fork()) == 0) {
+        int tfd;
+        assert((tfd = open(FILENAME, O_RDWR | O_TRUNC)) >= 0);
+        close(tfd);
+        s[PGSIZE] = 'x';
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &code) == 0 && code == -E_KILLED);
+    assert(munmap(s, MAPSIZE) == 0);
+    close(fd);
+    cprintf("shrunk file mapping ok.\n");
+}
+
+int
+main(void) {
+    test_anonymous();
+    test_file();
+    test_megapage();
+    test_file_shrink();
+    cprintf("mmaptest pass.\n");
+    return 0;
+}